@@ -0,0 +1,700 @@
+#!/usr/bin/env python
+
+import sys, os, re, getopt, random
+import flocklab2metric
+
+def usage():
+  print("Usage: benchmark.py [-r <rates>] [-s <seeds>] [-k <sinks>] [-c <baseline>]")
+  print("")
+  print("  Host simulation of the slot schedule of group-project.c, Scenario 1 (static tree,")
+  print("  sink 22) against Scenario 2 (discovery, then the join path for nodes without a parent).")
+  print("  Prints one CSV line per run.")
+  print("")
+  print("  -r <rates>:    optional. comma separated data rates (default: 1,5,10,20)")
+  print("  -s <seeds>:    optional. number of random seeds per configuration (default: 5)")
+  print("  -k <sinks>:    optional. comma separated sinks for Scenario 2 (default: 22,1,10)")
+  print("  -c <baseline>: optional. CSV of a previous run, e.g. 'bench-baseline.csv'. Exits with")
+  print("                 a non-zero status if a configuration loses yield or needs more radio-on time")
+  print("")
+  print("  The schedule constants are read from group-project.c and project-conf.h, the script")
+  print("  fails if one of them is missing or they do not fit together.")
+
+##############################################################################
+#
+# Configuration, read from the sources
+#
+##############################################################################
+
+# the FlockLab nodes evaluated by flocklab2metric.py
+nodes = flocklab2metric.nodes
+
+# approximate connectivity (packet reception ratio), not measured: the links of the
+# static tree are good, a few cross links are lossy
+links = {
+  (22, 3): 0.95, (22, 28): 0.95, (22, 16): 0.95, (22, 6): 0.95, (22, 18): 0.95,
+  (3, 2): 0.95, (3, 10): 0.95, (3, 15): 0.95, (28, 8): 0.95, (28, 31): 0.95,
+  (31, 32): 0.95, (16, 33): 0.95, (33, 1): 0.95, (33, 4): 0.95,
+  (2, 10): 0.8, (10, 15): 0.7, (8, 31): 0.8, (1, 4): 0.8, (6, 3): 0.7,
+  (18, 28): 0.7, (6, 16): 0.6, (32, 8): 0.6, (4, 16): 0.6, (15, 22): 0.5,
+  (2, 6): 0.6, (18, 31): 0.5,
+}
+
+# not part of the sources
+LF_SECOND        = 32768   # RTIMER_EXT_SECOND_LF of the MSP430 platforms
+READINGS         = 200     # readings per node, as in flocklab2metric.py
+PHY_BYTES        = 10      # preamble, sync word, length and CRC
+BITRATE          = 250.0   # kbit/s
+SYNC_DONE        = 3.0     # s, t_zero + 1 s: first slot after the sync phase
+SCAN_DWELL       = 0.1     # s, radio_rcv() timeout per channel in scan_for_parent()
+ROUND_WRAP       = 256     # round_count is a uint8_t
+
+cfg = None
+
+def fail(msg):
+  sys.stderr.write("benchmark.py: %s\n" % msg)
+  sys.exit(2)
+
+def read_source(name):
+  path = os.path.join(os.path.dirname(os.path.abspath(__file__)), name)
+  f = open(path, "r")
+  text = f.read()
+  f.close()
+  return text
+
+def read_defines(text, values):
+  # numeric #defines, expressions may use earlier ones
+  for match in re.finditer(r'^\s*#define\s+(\w+)[ \t]+([^\n]*)$', text, re.M):
+    expr = re.sub(r'/\*.*?\*/|//.*', '', match.group(2)).strip()
+    if not re.match(r'^[\w\s()*/+-]+$', expr):
+      continue
+    try:
+      values[match.group(1)] = int(eval(expr.replace('/', '//'), {}, dict(values)))
+    except Exception:
+      pass
+
+def read_array(text, name):
+  match = re.search(r'\b%s\[\w+\]\s*=\s*\{([^}]*)\}' % name, text)
+  if match is None:
+    fail("%s[] not found in group-project.c" % name)
+  return [int(v) for v in match.group(1).split(',') if v.strip() != '']
+
+def read_block(text, start):
+  # body of the brace that opens at text[start]
+  depth = 0
+  for k in range(start, len(text)):
+    if text[k] == '{':
+      depth = depth + 1
+    elif text[k] == '}':
+      depth = depth - 1
+      if depth == 0:
+        return text[start + 1:k]
+  fail("unbalanced braces in group-project.c")
+
+def read_struct(text, name):
+  # fields and size of an MSP430 struct, 16 bit fields are 2 byte aligned
+  match = re.search(r'typedef struct \{([^}]*)\}\s*%s;' % name, text)
+  if match is None:
+    fail("struct %s not found in group-project.c" % name)
+  fields = {}
+  size = 0
+  for (ftype, fname, count) in re.findall(r'(uint8_t|uint16_t)\s+(\w+)(?:\[(\d+)\])?;', match.group(1)):
+    width = 1
+    if ftype == 'uint16_t':
+      width = 2
+      size = size + size % 2
+    count = int(count or 1)
+    fields[fname] = count
+    size = size + width * count
+  return (fields, size + size % 2)
+
+def read_config():
+  src = read_source('group-project.c')
+  conf = read_source('project-conf.h')
+  c = { 'RTIMER_EXT_SECOND_LF': LF_SECOND }
+  read_defines(conf, c)
+  read_defines(src, c)
+  for name in ['SLOT_COUNT', 'ROUND_SLOTS', 'JOIN_SLOT', 'JOIN_PERIOD', 'DISC_MAX_ROUNDS', 'IDLE_MAX_ROUNDS',
+               'CANDIDATE_COUNT', 'RX_BUFFER_COUNT', 'RF_CHANNEL_COUNT']:
+    if name not in c:
+      fail("#define %s not found" % name)
+
+  c['data_slot'] = read_array(src, 'data_slot')
+  c['data_channel'] = read_array(src, 'data_channel')
+  c['slot_mapping'] = [0] * c['SLOT_COUNT']
+  for (pos, node) in re.findall(r'slot_mapping\[(\d+)\]\s*=\s*(\d+);', src):
+    if int(pos) >= c['SLOT_COUNT']:
+      fail("slot_mapping[%s] is beyond SLOT_COUNT" % pos)
+    c['slot_mapping'][int(pos)] = int(node)
+  c['slot_div'] = [int(d) for d in re.findall(r'slot_time\s*=\s*RTIMER_EXT_SECOND_LF\s*/\s*(\d+);', src)]
+  match = re.search(r'timeout_ms\s*=\s*(\d+);', src)
+  if match is None or len(c['slot_div']) != 2:
+    fail("timeout_ms or the two slot_time settings not found in group-project.c")
+  c['timeout_ms'] = float(match.group(1))
+
+  (superpacket, c['superpacket_bytes']) = read_struct(src, 'lpsd_superpacket_t')
+  (discovery, c['discovery_bytes']) = read_struct(src, 'lpsd_discovery_t')
+  c['max_blocks'] = superpacket['src_id']
+  c['block'] = superpacket['seqn'] // superpacket['src_id']
+  c['max_peers'] = discovery['my_childs']
+
+  # static tree of Scenario 1: the sinkaddress == 22 branch that sets slots[]
+  tree = None
+  for match in re.finditer(r'if\(sinkaddress == 22\)\s*\{', src):
+    body = read_block(src, match.end() - 1)
+    if re.search(r'slots\[\d+\]\s*=\s*1;', body):
+      tree = body
+  if tree is None:
+    fail("static tree of Scenario 1 not found in group-project.c")
+  c['static_slots'] = {}
+  for (node, body) in re.findall(r'node_id == (\w+)\)\s*\{([^}]*)\}', tree):
+    if node == 'sinkaddress':
+      node = '22'
+    c['static_slots'][int(node)] = [int(k) for k in re.findall(r'slots\[(\d+)\]\s*=\s*1;', body)]
+
+  check_config(c)
+  return c
+
+def check_config(c):
+  # the model relies on these, fail rather than simulate something else
+  if len(c['data_slot']) != c['SLOT_COUNT'] or len(c['data_channel']) != c['SLOT_COUNT']:
+    fail("data_slot[] and data_channel[] need SLOT_COUNT entries")
+  if c['data_slot'][0] != c['JOIN_SLOT']:
+    fail("position 0 must be the join slot")
+  for pos in range(1, c['SLOT_COUNT']):
+    if c['slot_mapping'][pos] == 0:
+      fail("slot_mapping[%d] is not set" % pos)
+    if not 0 <= c['data_slot'][pos] < c['ROUND_SLOTS'] or c['data_slot'][pos] == c['JOIN_SLOT']:
+      fail("data_slot[%d] is not a shared slot" % pos)
+    if not 0 <= c['data_channel'][pos] < c['RF_CHANNEL_COUNT']:
+      fail("data_channel[%d] is not a channel index" % pos)
+    for other in range(1, pos):
+      if c['data_slot'][other] == c['data_slot'][pos] and c['data_channel'][other] == c['data_channel'][pos]:
+        fail("positions %d and %d send in the same slot on the same channel" % (other, pos))
+  for n in nodes:
+    if n not in c['slot_mapping']:
+      fail("node %d has no position in slot_mapping[]" % n)
+  listened = []
+  for positions in c['static_slots'].values():
+    listened.extend(positions)
+  if len(listened) != len(set(listened)) or 0 in listened:
+    fail("a node of the static tree has two parents or sends in the join slot")
+  if c['block'] * c['max_blocks'] != 20:
+    fail("the superpacket does not hold %d blocks of %d readings" % (c['max_blocks'], c['block']))
+
+def airtime(size):
+  return (size + PHY_BYTES) * 8 / BITRATE      # ms
+
+##############################################################################
+#
+# Model
+#
+##############################################################################
+
+def prr(a, b):
+  if (a, b) in links:
+    return links[(a, b)]
+  return links.get((b, a), 0.0)
+
+class Node:
+  def __init__(self, node_id, sink, datarate):
+    self.id = node_id
+    self.sink = (node_id == sink)
+    self.pos = cfg['slot_mapping'].index(node_id)
+    self.parent = None
+    self.backup = 0
+    self.hops = 0
+    self.slots = set()        # positions we listen to, slots[] of group-project.c
+    self.peers = []
+    self.sink_pos = 0
+    self.candidates = []      # (hops, id), sorted as add_candidate() does
+    self.listen_pos = {}      # shared slot -> position
+    self.relay = False
+    self.queue = []           # own readings not sent yet
+    self.packet = []          # blocks of children to forward, as (src, readings)
+    self.fwd_seqn = {}
+    self.next_tx_round = 0
+    self.idle_rounds = 0
+    self.join_listen = 0
+    self.join_ack = 0
+    self.join_state = None    # 'scan', 'request' or 'wait' while joining, None otherwise
+    self.join_target = 0
+    self.parent_pos = 0
+    self.scan_start = 0.0
+    self.held = None          # frame held as backup parent
+    self.watch_pos = 0
+    self.skip_until = {}
+    self.radio_on = 0.0       # ms
+    start = (10000 + (node_id * 111) % 500) / 1000.0
+    self.gen_times = [start + k / float(datarate) for k in range(READINGS)]
+    self.generated = 0
+
+  def generate(self, now):
+    while self.generated < READINGS and self.gen_times[self.generated] <= now:
+      self.generated = self.generated + 1
+      self.queue.append(self.generated)
+
+  def done(self):
+    if self.join_state is not None:
+      return False
+    return self.parent is None or (self.generated == READINGS and len(self.queue) == 0 and
+                                   len(self.packet) == 0 and self.held is None)
+
+def slot_usable(node, pos):
+  ds = cfg['data_slot']
+  if not node.sink and ds[pos] == ds[node.pos]:
+    return False
+  for k in node.slots:
+    if ds[k] == ds[pos]:
+      return False
+  return True
+
+def update_listen_slots(node):
+  ds = cfg['data_slot']
+  node.listen_pos = {}
+  for k in sorted(node.slots):
+    if (node.sink or ds[k] != ds[node.pos]) and ds[k] not in node.listen_pos:
+      node.listen_pos[ds[k]] = k
+  node.relay = len(node.listen_pos) > 0
+
+def add_candidate(node, hops, c):
+  k = len(node.candidates)
+  while k > 0 and node.candidates[k - 1][0] > hops:
+    k = k - 1
+  node.candidates.insert(k, (hops, c))
+  node.candidates = node.candidates[0:cfg['CANDIDATE_COUNT']]
+
+def discover(net, sink, rng):
+  # Scenario 2: the first round collects peers, then the do_discovery loop runs until
+  # every node has sent with a parent; returns the slots until the last connected node is done
+  smap = cfg['slot_mapping']
+  tx_time = airtime(cfg['discovery_bytes']) + 0.5
+  rx_time = airtime(cfg['discovery_bytes']) + 1.0
+  senders = [(p, smap[p]) for p in range(1, cfg['SLOT_COUNT']) if smap[p] in net]
+  for (p, tx) in senders:
+    net[tx].radio_on = net[tx].radio_on + tx_time
+    for rx in nodes:
+      if rx == tx:
+        continue
+      node = net[rx]
+      if rng.random() < prr(tx, rx):
+        node.radio_on = node.radio_on + rx_time
+        if tx == sink:
+          node.sink_pos = p
+        elif len(node.peers) < cfg['max_peers'] and slot_usable(node, p):
+          node.slots.add(p)
+          node.peers.append(tx)
+      else:
+        node.radio_on = node.radio_on + cfg['timeout_ms']
+  net[sink].parent = sink
+  pending = list(nodes)
+  rounds = 1
+  last = cfg['SLOT_COUNT']
+  while len(pending) > 0 and rounds < cfg['DISC_MAX_ROUNDS']:
+    rounds = rounds + 1
+    for (p, tx) in senders:
+      if tx not in pending:
+        continue
+      sender = net[tx]
+      sender.radio_on = sender.radio_on + tx_time
+      for rx in pending:
+        node = net[rx]
+        if rx == tx or not (p in node.slots or p == node.sink_pos):
+          continue
+        if rng.random() < prr(tx, rx):
+          node.radio_on = node.radio_on + rx_time
+          if sender.parent is not None and rx in sender.peers:
+            if node.parent is None:
+              node.parent = tx
+              node.hops = sender.hops + 1
+            else:
+              add_candidate(node, sender.hops, tx)
+        else:
+          node.radio_on = node.radio_on + cfg['timeout_ms']
+      if sender.parent is not None:
+        pending.remove(tx)
+        last = (rounds - 1) * cfg['SLOT_COUNT'] + p + 1
+        select_backup(sender)
+  # DISC_MAX_ROUNDS: nodes with a parent still send once, the others join instead
+  for (p, tx) in senders:
+    if tx in pending and net[tx].parent is not None:
+      net[tx].radio_on = net[tx].radio_on + tx_time
+      last = rounds * cfg['SLOT_COUNT'] + p + 1
+      select_backup(net[tx])
+    elif tx in pending:
+      net[tx].join_state = 'scan'
+  return last
+
+def select_backup(node):
+  for (hops, c) in node.candidates:
+    if c != node.parent and hops < node.hops:
+      node.backup = c
+      break
+
+def next_join_round(rnd):
+  period = cfg['JOIN_PERIOD']
+  r = rnd + (period - 1) - (rnd % period)
+  if r == rnd:
+    r = r + period
+  return r
+
+def beacon(sink, rnd):
+  # the sink announces its next join slot on channel 0, position 0
+  sink.join_listen = next_join_round(rnd)
+  frame = { 'src': sink.id, 'blocks': [], 'next_round': 0, 'dst': 0, 'backup': 0, 'hops': 0,
+            'join_open': sink.join_listen, 'join_ack': sink.join_ack }
+  sink.join_ack = 0
+  return frame
+
+def join_requests(net, rnd, rng):
+  # join slot: requests go to the parent in the round it announced, a parent takes the first
+  # request it hears; returns the nodes that listened
+  listening = [n for n in nodes if net[n].join_listen == rnd]
+  waiting = list(listening)
+  for n in nodes:
+    node = net[n]
+    if node.join_state != 'request' or node.join_target != rnd:
+      continue
+    node.join_state = 'wait'
+    node.radio_on = node.radio_on + airtime(cfg['discovery_bytes']) + 0.5
+    parent = net[node.parent]
+    if node.parent in waiting and rng.random() < prr(n, node.parent):
+      waiting.remove(node.parent)
+      parent.radio_on = parent.radio_on + airtime(cfg['discovery_bytes']) + 1.0
+      if node.pos in parent.slots:
+        parent.join_ack = n
+      elif slot_usable(parent, node.pos):
+        parent.slots.add(node.pos)
+        update_listen_slots(parent)
+        parent.join_ack = n
+  for n in waiting:
+    net[n].radio_on = net[n].radio_on + cfg['timeout_ms']
+  for n in listening:
+    net[n].join_listen = 0
+  return listening
+
+def join_network(node, pos, frame, rnd, timing):
+  # the slots restart two rounds after the frame, on the first round one second after t_zero;
+  # a join slot announced before that is only reached once round_count wraps
+  node.parent = frame['src']
+  node.parent_pos = pos
+  node.hops = frame['hops'] + 1
+  node.join_target = frame['join_open']
+  while node.join_target < rnd + 2 + timing['sync_rounds']:
+    node.join_target = node.join_target + ROUND_WRAP
+  node.join_state = 'request'
+
+def joining(node, rnd, now, s, frames, rng, timing):
+  # scan_for_parent() and the join states of group-project.c, True once acknowledged
+  ds = cfg['data_slot']
+  if node.join_state == 'scan' and now >= node.scan_start:
+    node.radio_on = node.radio_on + timing['slot_s'] * 1000.0
+    channel = int((now - node.scan_start) / SCAN_DWELL) % cfg['RF_CHANNEL_COUNT']
+    for p in sorted(frames):
+      frame = frames[p]
+      if (frame is not None and frame['join_open'] and cfg['data_channel'][p] == channel and ds[p] != ds[node.pos]
+          and rng.random() < prr(frame['src'], node.id)):
+        join_network(node, p, frame, rnd, timing)
+        break
+  elif node.join_state == 'wait' and s == ds[node.parent_pos]:
+    frame = frames.get(node.parent_pos)
+    if frame is not None and rng.random() < prr(node.parent, node.id):
+      node.radio_on = node.radio_on + airtime(cfg['superpacket_bytes']) + 1.0
+      if frame['join_ack'] == node.id:
+        node.join_state = None
+        return True
+      if frame['join_open']:
+        node.join_target = frame['join_open']
+        node.join_state = 'request'
+    else:
+      node.radio_on = node.radio_on + cfg['timeout_ms']
+  return False
+
+def simulate(scenario, sink, datarate, seed):
+  rng = random.Random(seed * 1000 + datarate * 100 + sink)
+  net = dict([(n, Node(n, sink, datarate)) for n in nodes])
+  smap = cfg['slot_mapping']
+  ds = cfg['data_slot']
+  if datarate == 1:
+    slot_ticks = LF_SECOND // cfg['slot_div'][0]
+  else:
+    slot_ticks = LF_SECOND // cfg['slot_div'][1]
+  slot_s = slot_ticks / float(LF_SECOND)
+  timing = { 'round_ticks': cfg['ROUND_SLOTS'] * slot_ticks, 'reading_ticks': LF_SECOND // datarate,
+             'scenario': scenario, 'slot_s': slot_s }
+  timing['sync_rounds'] = (LF_SECOND + timing['round_ticks'] - 1) // timing['round_ticks']
+
+  if scenario == 1:
+    for n in nodes:
+      net[n].parent = sink
+    for relay in sorted(cfg['static_slots']):
+      for k in cfg['static_slots'][relay]:
+        if relay in net and smap[k] in net:
+          net[relay].slots.add(k)
+          net[smap[k]].parent = relay
+    startup = SYNC_DONE
+  else:
+    startup = SYNC_DONE + discover(net, sink, rng) * slot_s
+    for n in nodes:
+      net[n].scan_start = SYNC_DONE + cfg['DISC_MAX_ROUNDS'] * cfg['SLOT_COUNT'] * slot_s
+  joined = 0
+  for n in nodes:
+    update_listen_slots(net[n])
+  senders = dict([(s, []) for s in range(cfg['ROUND_SLOTS'])])
+  for p in range(1, cfg['SLOT_COUNT']):
+    if smap[p] in net and smap[p] != sink and net[smap[p]].parent is not None:
+      senders[ds[p]].append(p)
+
+  delivered = dict([(n, set()) for n in nodes])
+  rx_buffers = []             # blocks and readings per buffer still to print at the sink
+  backlog_max = 0
+
+  def sink_print(count):
+    while count > 0 and len(rx_buffers) > 0:
+      buf = rx_buffers[0]
+      take = min(count, len(buf['rest']))
+      for (src, seqn) in buf['rest'][0:take]:
+        delivered[src].add(seqn)
+      buf['rest'] = buf['rest'][take:]
+      count = count - take
+      if len(buf['rest']) == 0:
+        rx_buffers.pop(0)
+
+  def sink_receive(blocks):
+    # the first reading of every block is printed on reception, short frames are packed
+    rest = []
+    for (src, readings) in blocks:
+      if len(readings) > 0:
+        delivered[src].add(readings[0])
+        rest.extend([(src, r) for r in readings[1:]])
+    if len(rx_buffers) > 0 and rx_buffers[-1]['blocks'] + len(blocks) <= cfg['max_blocks']:
+      rx_buffers[-1]['blocks'] = rx_buffers[-1]['blocks'] + len(blocks)
+      rx_buffers[-1]['rest'].extend(rest)
+    else:
+      rx_buffers.append({ 'blocks': len(blocks), 'rest': rest })
+
+  end = 10.5 + READINGS / float(datarate) + 30.0
+  rx_time = airtime(cfg['superpacket_bytes']) + 1.0
+  rnd = 0
+  now = startup
+  while now <= end:
+    rnd = rnd + 1
+    for s in range(cfg['ROUND_SLOTS']):
+      now = startup + ((rnd - 1) * cfg['ROUND_SLOTS'] + s) * slot_s
+      for n in nodes:
+        net[n].generate(now)
+      # the sink writes its own readings, one per slot
+      if len(net[sink].queue) > 0:
+        delivered[sink].add(net[sink].queue.pop(0))
+      frames = {}
+      if s == cfg['JOIN_SLOT']:
+        # the sink's beacon, or parents listen in the join slots they announced
+        if rnd % cfg['JOIN_PERIOD'] == cfg['JOIN_PERIOD'] // 2:
+          frames[0] = beacon(net[sink], rnd)
+        elif sink not in join_requests(net, rnd, rng):
+          sink_print(4)
+      else:
+        for p in senders[s]:
+          frames[p] = transmit(net[smap[p]], rnd, timing)
+      for n in nodes:
+        node = net[n]
+        if node.join_state is not None:
+          if joining(node, rnd, now, s, frames, rng, timing):
+            senders[ds[node.pos]].append(node.pos)
+            joined = joined + 1
+          continue
+        if s == cfg['JOIN_SLOT']:
+          continue
+        pos = node.listen_pos.get(s, 0)
+        if pos == 0 and node.held is not None and ds[node.watch_pos] == s:
+          pos = node.watch_pos
+        if pos != 0 and node.skip_until.get(pos, 0) > rnd:
+          pos = 0
+        if pos == 0:
+          if node.sink:
+            sink_print(4)
+          continue
+        frame = frames.get(pos)
+        heard = frame is not None and rng.random() < prr(smap[pos], n)
+        if node.sink:
+          if len(rx_buffers) == cfg['RX_BUFFER_COUNT']:
+            sink_print(3)
+            if len(rx_buffers) == cfg['RX_BUFFER_COUNT']:
+              continue
+          if heard:
+            node.skip_until[pos] = frame['next_round']
+            sink_receive(frame['blocks'])
+          else:
+            sink_print(3)
+          continue
+        if heard:
+          node.radio_on = node.radio_on + rx_time
+          receive(node, pos, frame)
+        else:
+          node.radio_on = node.radio_on + cfg['timeout_ms']
+          receive(node, pos, None)
+      backlog_max = max(backlog_max, sum([len(b['rest']) for b in rx_buffers]))
+    if all([net[n].done() for n in nodes]):
+      break
+
+  backlog_end = sum([len(b['rest']) for b in rx_buffers])
+  sink_print(READINGS * len(nodes))
+  duration = (now - SYNC_DONE) * 1000.0
+  radio = [net[n].radio_on / duration * 1000.0 for n in nodes if n != sink]
+  datayield = sum([len(delivered[n]) for n in nodes]) / float(READINGS * len(nodes))
+  return { 'yield': datayield, 'radio_ms_per_s': sum(radio) / len(radio),
+           'startup_s': startup, 'backlog_max': backlog_max, 'backlog_end': backlog_end, 'joined': joined }
+
+def transmit(node, rnd, timing):
+  # skip_transmission() and announce_next_round() of group-project.c
+  block = cfg['block']
+  queued = len(node.queue)
+  if node.next_tx_round > rnd or (len(node.packet) == 0 and not (queued >= block or
+                                  (queued > 0 and node.idle_rounds >= cfg['IDLE_MAX_ROUNDS']))):
+    node.idle_rounds = node.idle_rounds + 1
+    return None
+  own = node.queue[0:block]
+  node.queue = node.queue[block:]
+  wait = 1
+  if not node.relay and len(node.queue) < block:
+    wait = ((block - len(node.queue)) * timing['reading_ticks'] + timing['round_ticks'] - 1) // timing['round_ticks']
+    wait = min(cfg['IDLE_MAX_ROUNDS'], wait)
+  dst = 0
+  join_open = 0
+  if timing['scenario'] == 2:
+    dst = node.parent
+    if node.relay:
+      join_open = next_join_round(rnd)
+  node.join_listen = join_open
+  frame = { 'src': node.id, 'blocks': [(node.id, own)] + node.packet, 'next_round': rnd + wait, 'dst': dst,
+            'backup': node.backup, 'hops': node.hops, 'join_open': join_open, 'join_ack': node.join_ack }
+  node.join_ack = 0
+  node.packet = []
+  node.next_tx_round = rnd + wait
+  node.idle_rounds = 0
+  node.radio_on = node.radio_on + airtime(cfg['superpacket_bytes']) + 0.5
+  return frame
+
+def receive(node, pos, frame):
+  # receive path of group-project.c, frame is None if nothing was heard
+  if frame is None:
+    if node.held is not None and pos == node.watch_pos:
+      resolve_backup(node, None)
+    return
+  node.skip_until[pos] = frame['next_round']
+  if node.held is not None and pos == node.watch_pos:
+    resolve_backup(node, frame)
+  if frame['dst'] == 0 or frame['dst'] == node.id:
+    merge(node, frame, False, None)
+  elif frame['backup'] == node.id and frame['hops'] > node.hops:
+    if node.held is not None:
+      resolve_backup(node, None)
+    watch = cfg['slot_mapping'].index(frame['dst'])
+    if slot_usable(node, watch):
+      node.watch_pos = watch
+      node.held = frame
+  elif pos in node.slots:
+    # a peer that chose another parent
+    node.slots.discard(pos)
+    update_listen_slots(node)
+
+def resolve_backup(node, primary):
+  merge(node, node.held, True, primary)
+  node.held = None
+
+def carries_block(frame, src, first):
+  for (s, readings) in frame['blocks']:
+    if s == src and len(readings) > 0 and readings[0] == first:
+      return True
+  return False
+
+def merge(node, frame, backup, primary):
+  # merge_blocks() of group-project.c, the backup parent skips what it or the primary holds
+  for (src, readings) in reversed(frame['blocks']):
+    if len(node.packet) >= cfg['max_blocks'] - 1:
+      break
+    first = 0
+    if len(readings) > 0:
+      first = readings[0]
+    if backup:
+      if first <= node.fwd_seqn.get(src, 0) or (primary is not None and carries_block(primary, src, first)):
+        continue
+    node.fwd_seqn[src] = max(first, node.fwd_seqn.get(src, 0))
+    node.packet.append((src, readings))
+
+##############################################################################
+#
+# Main
+#
+##############################################################################
+fields = ['scenario', 'sink', 'datarate', 'seed', 'yield', 'radio_ms_per_s', 'startup_s', 'backlog_max', 'backlog_end',
+          'joined']
+
+def main(argv):
+
+  global cfg
+  rates = [1, 5, 10, 20]
+  seeds = 5
+  sinks = [22, 1, 10]
+  baselinefile = None
+
+  try:
+    (opts, args) = getopt.getopt(argv, "r:s:k:c:h")
+  except getopt.GetoptError:
+    usage()
+    sys.exit(2)
+  for (opt, val) in opts:
+    if opt == '-r':
+      rates = [int(r) for r in val.split(',')]
+    elif opt == '-s':
+      seeds = int(val)
+    elif opt == '-k':
+      sinks = [int(k) for k in val.split(',')]
+    elif opt == '-c':
+      baselinefile = val
+    else:
+      usage()
+      sys.exit()
+
+  cfg = read_config()
+
+  configs = []
+  for datarate in rates:
+    configs.append((1, 22, datarate))
+    for sink in sinks:
+      configs.append((2, sink, datarate))
+
+  results = {}
+  print(",".join(fields))
+  for (scenario, sink, datarate) in configs:
+    for seed in range(1, seeds + 1):
+      r = simulate(scenario, sink, datarate, seed)
+      print("%d,%d,%d,%d,%0.4f,%0.3f,%0.2f,%d,%d,%d" % (scenario, sink, datarate, seed, r['yield'],
+            r['radio_ms_per_s'], r['startup_s'], r['backlog_max'], r['backlog_end'], r['joined']))
+      results[(scenario, sink, datarate, seed)] = r
+
+  if baselinefile is not None:
+    if compare_baseline(baselinefile, results):
+      sys.exit(1)
+
+def compare_baseline(baselinefile, results):
+  # yield must not drop and radio-on time must not grow by more than 1 %
+  regressions = 0
+  bf = open(baselinefile, "r")
+  header = bf.readline().strip().split(',')
+  for line in bf:
+    values = dict(zip(header, line.strip().split(',')))
+    key = (int(values['scenario']), int(values['sink']), int(values['datarate']), int(values['seed']))
+    if key not in results:
+      continue
+    r = results[key]
+    if r['yield'] < float(values['yield']) - 0.01:
+      sys.stderr.write("Regression %s: yield %0.4f < %s\n" % (str(key), r['yield'], values['yield']))
+      regressions = regressions + 1
+    if r['radio_ms_per_s'] > float(values['radio_ms_per_s']) * 1.01:
+      sys.stderr.write("Regression %s: radio-on %0.3f > %s ms/s\n" % (str(key), r['radio_ms_per_s'], values['radio_ms_per_s']))
+      regressions = regressions + 1
+  bf.close()
+  return regressions
+
+if __name__ == "__main__":
+  main(sys.argv[1:])
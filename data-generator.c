@@ -40,14 +40,32 @@
 /*---------------------------------------------------------------------------*/
 extern uint16_t datarate;
 extern uint16_t randomseed;
+#if DATA_QUEUE_CONF_RING
+/* packed ring buffer, the source ID is always node_id */
+static uint8_t  ring_seqn[PACKET_QUEUE_SIZE];
+static uint16_t ring_payload[PACKET_QUEUE_SIZE];
+static uint16_t ring_head;
+static uint16_t ring_count;
+/* packet returned by get_data() and pop_data() */
+static lpsd_packet_queue_t ring_pkt;
+#else
 QUEUE(packet_queue);
 MEMB(packet_memb, lpsd_packet_queue_t, PACKET_QUEUE_SIZE);
+#endif /* DATA_QUEUE_CONF_RING */
+/* readings dropped because the queue was full */
+static uint16_t overflow_count;
 /*---------------------------------------------------------------------------*/
 void data_generation_init(void)
 {
   /* initialize the packet queue */
+#if DATA_QUEUE_CONF_RING
+  ring_head = 0;
+  ring_count = 0;
+#else
   memb_init(&packet_memb);
   queue_init(packet_queue);
+#endif /* DATA_QUEUE_CONF_RING */
+  overflow_count = 0;
 
   /* initialize the random generator */
   random_init(randomseed);
@@ -73,9 +91,26 @@ void generate_new_data(void)
     seqn++;
   }
 
+#if DATA_QUEUE_CONF_RING
+  if(ring_count == PACKET_QUEUE_SIZE) {
+    //LOG_INFO("Data queue overflow!\n");
+    overflow_count++;
+    return;
+  }
+  uint16_t tail = ring_head + ring_count;
+  if(tail >= PACKET_QUEUE_SIZE) {
+    tail -= PACKET_QUEUE_SIZE;
+  }
+  ring_seqn[tail]    = seqn;
+  ring_payload[tail] = random_rand();
+
+  /* add packet to the queue */
+  ring_count++;
+#else
   lpsd_packet_queue_t* pkt = memb_alloc(&packet_memb);
   if(pkt == 0) {
     //LOG_INFO("Data queue overflow!\n");
+    overflow_count++;
     return;
   }
   pkt->src_id   = node_id;
@@ -84,26 +119,88 @@ void generate_new_data(void)
 
   /* add packet to the queue */
   queue_enqueue(packet_queue, pkt);
+#endif /* DATA_QUEUE_CONF_RING */
 }
 /*---------------------------------------------------------------------------*/
 void* get_data()
 {
+#if DATA_QUEUE_CONF_RING
+  /* copy the first packet */
+  ring_pkt.src_id   = node_id;
+  ring_pkt.seqn     = ring_seqn[ring_head];
+  ring_pkt.payload  = ring_payload[ring_head];
+  return (&(ring_pkt.src_id));
+#else
   /* peek at the first packet */
   lpsd_packet_queue_t* pkt = queue_peek(packet_queue);
   return (&(pkt->src_id));
+#endif /* DATA_QUEUE_CONF_RING */
 }
 /*---------------------------------------------------------------------------*/
 void* pop_data()
 {
+#if DATA_QUEUE_CONF_RING
+  /* copy and remove the first packet, the copy stays valid until the next call */
+  get_data();
+  if(++ring_head == PACKET_QUEUE_SIZE) {
+    ring_head = 0;
+  }
+  ring_count--;
+  return (&(ring_pkt.src_id));
+#else
   /* dequeue the first packet */
   lpsd_packet_queue_t* pkt = queue_dequeue(packet_queue);
   /* free the memory block */
   memb_free(&packet_memb, pkt);
   /* return the corresponding packet pointer */
   return (&(pkt->src_id));
+#endif /* DATA_QUEUE_CONF_RING */
+}
+/*---------------------------------------------------------------------------*/
+uint8_t pop_data_n(uint8_t* seqn, uint16_t* payload, uint8_t n)
+{
+  uint8_t count = 0;
+#if DATA_QUEUE_CONF_RING
+  while(count < n && ring_count > 0) {
+    seqn[count]    = ring_seqn[ring_head];
+    payload[count] = ring_payload[ring_head];
+    if(++ring_head == PACKET_QUEUE_SIZE) {
+      ring_head = 0;
+    }
+    ring_count--;
+    count++;
+  }
+#else
+  while(count < n && is_data_in_queue()) {
+    lpsd_packet_queue_t* pkt = queue_dequeue(packet_queue);
+    seqn[count]    = pkt->seqn;
+    payload[count] = pkt->payload;
+    memb_free(&packet_memb, pkt);
+    count++;
+  }
+#endif /* DATA_QUEUE_CONF_RING */
+  return count;
+}
+/*---------------------------------------------------------------------------*/
+uint16_t data_queue_length(void)
+{
+#if DATA_QUEUE_CONF_RING
+  return ring_count;
+#else
+  return list_length(packet_queue);
+#endif /* DATA_QUEUE_CONF_RING */
+}
+/*---------------------------------------------------------------------------*/
+uint16_t data_overflow_count(void)
+{
+  return overflow_count;
 }
 /*---------------------------------------------------------------------------*/
 uint8_t is_data_in_queue(){
+#if DATA_QUEUE_CONF_RING
+  return ring_count == 0 ? 0 : 1;
+#else
   return *packet_queue == NULL ? 0 : 1;
+#endif /* DATA_QUEUE_CONF_RING */
 }
 /*---------------------------------------------------------------------------*/
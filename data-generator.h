@@ -71,6 +71,28 @@ void* get_data(void);
  */
 void* pop_data(void);
 
+/**
+ * @brief     Removes up to n data packets at once
+ *            (all packets have src_id node_id)
+ * @param     seqn      Array receiving the sequence numbers
+ * @param     payload   Array receiving the payloads
+ * @param     n         Maximum number of packets to remove
+ * @return    The number of packets removed
+ */
+uint8_t pop_data_n(uint8_t* seqn, uint16_t* payload, uint8_t n);
+
+/**
+ * @brief     Counts the data packets in the queue
+ * @return    The number of packets in the queue
+ */
+uint16_t data_queue_length(void);
+
+/**
+ * @brief     Counts the data packets dropped because the queue was full
+ * @return    The number of packets dropped since data_generation_init()
+ */
+uint16_t data_overflow_count(void);
+
 /**
  * @brief     Checks if a queue is empty
  * @return    True    if there is packets in the queue
@@ -0,0 +1,268 @@
+#!/usr/bin/env python
+
+import sys, os, re, getopt, math, tarfile, zipfile, functools
+from multiprocessing import Pool
+import flocklab2metric
+
+def usage():
+  print("Usage: flocklab2batch.py [-j <jobs>] [-a <alpha>] [-s <sink>] [-d <datarate>] <baseline-dir> <candidate-dir>")
+  print("")
+  print("  -j <jobs>:       optional. number of results scored in parallel (default: number of CPUs)")
+  print("  -a <alpha>:      optional. family-wise significance level of the regression tests (default: 0.05)")
+  print("  -s <sink>:       optional. sink address of results without 'sink<N>' in their name (default: 22)")
+  print("  -d <datarate>:   optional. data rate of results without 'dr<N>' in their name (default: 1)")
+  print("  <baseline-dir>:  directory of FlockLab results (.tar.gz, .zip or unpacked directories)")
+  print("  <candidate-dir>: directory of FlockLab results of the change under review")
+  print("")
+  print("  A result must contain 'serial.csv' and may contain 'powerprofilingstats.csv'.")
+  print("  Results are compared per (sink, data rate), all tests are corrected together (Holm).")
+  print("  Exits with a non-zero status if a significant regression is found.")
+
+##############################################################################
+#
+# Main
+#
+##############################################################################
+def main(argv):
+
+  jobs = None
+  alpha = 0.05
+  defaultsink = 22
+  defaultrate = 1
+
+  try:
+    (opts, args) = getopt.getopt(argv, "j:a:s:d:")
+  except getopt.GetoptError:
+    usage()
+    sys.exit(2)
+  for (opt, val) in opts:
+    if opt == '-j':
+      jobs = int(val)
+    elif opt == '-a':
+      alpha = float(val)
+    elif opt == '-s':
+      defaultsink = int(val)
+    elif opt == '-d':
+      defaultrate = int(val)
+
+  if len(args) < 2:
+    usage()
+    sys.exit()
+
+  baseline = list_results(args[0])
+  candidate = list_results(args[1])
+
+  # the workers may not share our globals (spawn), hand them the defaults
+  score = functools.partial(score_result, defaultsink=defaultsink, defaultrate=defaultrate)
+  pool = Pool(jobs)
+  baseline = [r for r in pool.map(score, baseline) if r is not None]
+  candidate = [r for r in pool.map(score, candidate) if r is not None]
+  pool.close()
+
+  # only runs with the same sink and data rate are comparable
+  groups = sorted(set([(r['sink'], r['datarate']) for r in baseline + candidate]))
+  tests = []
+  for (sink, rate) in groups:
+    base = [r for r in baseline if (r['sink'], r['datarate']) == (sink, rate)]
+    cand = [r for r in candidate if (r['sink'], r['datarate']) == (sink, rate)]
+    label = "sink %d, datarate %d" % (sink, rate)
+    if len(base) == 0 or len(cand) == 0:
+      print("%s: no results to compare (%d baseline, %d candidate)" % (label, len(base), len(cand)))
+      continue
+    print("%s: %d baseline and %d candidate results" % (label, len(base), len(cand)))
+    tests.extend(group_tests(label, base, cand))
+
+  if len(tests) == 0:
+    print("No results to compare (%d baseline, %d candidate)" % (len(baseline), len(candidate)))
+    sys.exit(1)
+
+  # Holm-Bonferroni over every test of every group keeps the family-wise error at alpha
+  holm(tests)
+  print("%-24s %-12s %10s %10s %10s %8s" % ('', '', 'baseline', 'candidate', 'delta', 'p(holm)'))
+  regressions = 0
+  for test in tests:
+    worse = (test['cand'] - test['base']) * test['sign'] < 0 and test['padj'] < alpha
+    flag = ''
+    if worse:
+      flag = '  REGRESSION'
+      regressions = regressions + 1
+    print("%-24s %-12s %10.3f %10.3f %+10.3f %8.3f%s" % (test['group'], test['name'], test['base'], test['cand'],
+                                                        test['cand'] - test['base'], test['padj'], flag))
+
+  if regressions:
+    print("%d significant regression(s) in %d tests" % (regressions, len(tests)))
+    sys.exit(1)
+  print("No significant regression in %d tests" % len(tests))
+
+def group_tests(label, baseline, candidate):
+  # a lower yield or metric is worse, a higher current is worse
+  tests = []
+  add_test(tests, label, 'metric', [r['metric'] for r in baseline if 'metric' in r],
+           [r['metric'] for r in candidate if 'metric' in r], 1)
+  add_test(tests, label, 'yield', [r['yield'] for r in baseline], [r['yield'] for r in candidate], 1)
+  add_test(tests, label, 'current', [r['current'] for r in baseline if 'current' in r],
+           [r['current'] for r in candidate if 'current' in r], -1)
+  for node in sorted(flocklab2metric.nodes):
+    add_test(tests, label, 'yield %d' % node, [r['nodes'][node] for r in baseline if node in r['nodes']],
+             [r['nodes'][node] for r in candidate if node in r['nodes']], 1)
+  for node in sorted(flocklab2metric.nodes):
+    add_test(tests, label, 'current %d' % node, [r['currents'][node] for r in baseline if node in r['currents']],
+             [r['currents'][node] for r in candidate if node in r['currents']], -1)
+  return tests
+
+def list_results(directory):
+  results = []
+  for name in sorted(os.listdir(directory)):
+    path = os.path.join(directory, name)
+    if os.path.isdir(path) or name.endswith('.tar.gz') or name.endswith('.tgz') or name.endswith('.zip'):
+      results.append(path)
+  return results
+
+def read_members(path):
+  # returns the lines of serial.csv and powerprofilingstats.csv (None if missing)
+  files = { 'serial.csv': None, 'powerprofilingstats.csv': None }
+  if os.path.isdir(path):
+    for (root, dirs, names) in os.walk(path):
+      for name in names:
+        if name in files:
+          f = open(os.path.join(root, name), "r")
+          files[name] = f.read().splitlines(True)
+          f.close()
+  elif path.endswith('.zip'):
+    zf = zipfile.ZipFile(path)
+    for member in zf.namelist():
+      if os.path.basename(member) in files:
+        files[os.path.basename(member)] = zf.read(member).decode('ascii', 'replace').splitlines(True)
+    zf.close()
+  else:
+    tf = tarfile.open(path, "r:*")
+    for member in tf.getmembers():
+      if member.isfile() and os.path.basename(member.name) in files:
+        files[os.path.basename(member.name)] = tf.extractfile(member).read().decode('ascii', 'replace').splitlines(True)
+    tf.close()
+  return (files['serial.csv'], files['powerprofilingstats.csv'])
+
+def score_result(path, defaultsink, defaultrate):
+  # same scoring as flocklab2metric.py, per node and overall
+  match = re.search(r'sink(\d+)', os.path.basename(path))
+  if match:
+    sinknode = int(match.group(1))
+  else:
+    sinknode = defaultsink
+  match = re.search(r'(?:datarate|dr)(\d+)', os.path.basename(path))
+  if match:
+    datarate = int(match.group(1))
+  else:
+    datarate = defaultrate
+
+  try:
+    (serial, power) = read_members(path)
+  except Exception as e:
+    print("%s: %s" % (path, e))
+    return None
+  if serial is None:
+    print("%s: no serial.csv" % path)
+    return None
+
+  sources = flocklab2metric.read_sources(serial, sinknode)
+  data_payload = flocklab2metric.read_expected("expected_data.lst")
+
+  result = { 'name': path, 'sink': sinknode, 'datarate': datarate, 'nodes': {}, 'currents': {} }
+  datayield = 0
+  for node in flocklab2metric.nodes:
+    pk_ok = 0
+    if node in sources:
+      pk_ok = flocklab2metric.check_data(node, sources[node], data_payload)
+    result['nodes'][node] = pk_ok / 200.0
+    datayield = datayield + pk_ok
+  result['yield'] = float(datayield) / (len(flocklab2metric.nodes) * 200.0)
+
+  if power is not None:
+    result['currents'] = flocklab2metric.read_power(power, sinknode)
+    if len(result['currents']) > 0:
+      result['current'] = sum(result['currents'].values()) / float(len(result['currents']))
+      kpi_current = 1 - (result['current'] / 25.0)
+      result['metric'] = kpi_current * 0.5 + result['yield'] * 0.5
+  return result
+
+def add_test(tests, group, name, base, cand, sign):
+  # sign is 1 if higher is better, -1 if lower is better
+  if len(base) == 0 or len(cand) == 0:
+    return
+  tests.append({ 'group': group, 'name': name, 'base': mean(base), 'cand': mean(cand), 'sign': sign,
+                 'p': welch_p(base, cand) })
+
+def holm(tests):
+  # sets 'padj' to the Holm adjusted p-value of every test
+  order = sorted(range(len(tests)), key=lambda k: tests[k]['p'])
+  padj = 0.0
+  for (rank, k) in enumerate(order):
+    padj = max(padj, min(1.0, (len(tests) - rank) * tests[k]['p']))
+    tests[k]['padj'] = padj
+
+def mean(values):
+  return sum(values) / float(len(values))
+
+def variance(values):
+  if len(values) < 2:
+    return 0.0
+  m = mean(values)
+  return sum([(v - m) ** 2 for v in values]) / float(len(values) - 1)
+
+def welch_p(a, b):
+  # two-sided p-value of Welch's t-test, 1.0 if it cannot be computed
+  va = variance(a) / len(a)
+  vb = variance(b) / len(b)
+  if len(a) < 2 or len(b) < 2 or va + vb == 0.0:
+    return 1.0
+  t = (mean(a) - mean(b)) / math.sqrt(va + vb)
+  df = (va + vb) ** 2 / (va ** 2 / (len(a) - 1) + vb ** 2 / (len(b) - 1))
+  return betai(df / 2.0, 0.5, df / (df + t * t))
+
+def betai(a, b, x):
+  # regularized incomplete beta function I_x(a, b)
+  if x <= 0.0:
+    return 0.0
+  if x >= 1.0:
+    return 1.0
+  bt = math.exp(math.lgamma(a + b) - math.lgamma(a) - math.lgamma(b) + a * math.log(x) + b * math.log(1.0 - x))
+  if x < (a + 1.0) / (a + b + 2.0):
+    return bt * betacf(a, b, x) / a
+  return 1.0 - bt * betacf(b, a, 1.0 - x) / b
+
+def betacf(a, b, x):
+  # continued fraction of the incomplete beta function (modified Lentz)
+  tiny = 1e-30
+  c = 1.0
+  d = 1.0 - (a + b) * x / (a + 1.0)
+  if abs(d) < tiny:
+    d = tiny
+  d = 1.0 / d
+  h = d
+  for m in range(1, 201):
+    m2 = 2 * m
+    aa = m * (b - m) * x / ((a + m2 - 1.0) * (a + m2))
+    d = 1.0 + aa * d
+    if abs(d) < tiny:
+      d = tiny
+    c = 1.0 + aa / c
+    if abs(c) < tiny:
+      c = tiny
+    d = 1.0 / d
+    h = h * d * c
+    aa = -(a + m) * (a + b + m) * x / ((a + m2) * (a + m2 + 1.0))
+    d = 1.0 + aa * d
+    if abs(d) < tiny:
+      d = tiny
+    c = 1.0 + aa / c
+    if abs(c) < tiny:
+      c = tiny
+    d = 1.0 / d
+    delta = d * c
+    h = h * delta
+    if abs(delta - 1.0) < 3e-12:
+      break
+  return h
+
+if __name__ == "__main__":
+  main(sys.argv[1:])
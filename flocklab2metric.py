@@ -3,12 +3,17 @@
 import sys, os, getopt
 from struct import *
 
+nodes = [22,2,4,8,15,3,31,32,33,6,16,1,28,18,10]
+# fields of the "Cnt:" line, in the order of lpsd_counters_t in group-project.c
+counter_names = ['rx', 'rx_missed', 'tx', 'merge_dropped', 'alloc_failed', 'gen_overflow', 'gen_unsent',
+                 'sync_heard', 'join_retries', 'backup_forwarded', 'tx_skipped', 'rx_skipped']
+
 def usage():
-  print "Usage: flocklab2metric.py <sink address> <serial-input> <powersummary>"
-  print ""
-  print "  <sink address>: address of the sink node (so to exclude it from the metric evaluation)"
-  print "  <serial-input>: serial file generated by FlockLab"
-  print "  <powersummary>: optional. 'powerprofilingstats.csv' from FlockLab"
+  print("Usage: flocklab2metric.py <sink address> <serial-input> <powersummary>")
+  print("")
+  print("  <sink address>: address of the sink node (so to exclude it from the metric evaluation)")
+  print("  <serial-input>: serial file generated by FlockLab")
+  print("  <powersummary>: optional. 'powerprofilingstats.csv' from FlockLab")
 
 ##############################################################################
 #
@@ -19,7 +24,6 @@ def main(argv):
 
   serialfile = None
   powerfile = None
-  nodes = [22,2,4,8,15,3,31,32,33,6,16,1,28,18,10]
   
   if len(argv) < 2:
     usage()
@@ -34,11 +38,40 @@ def main(argv):
   
   sinknode = int(argv[0]) # this node is not included in power assesment
   
+  sources = read_sources(inf, sinknode)
+  #inf.close()
+  counters = read_counters(open(serialfile, "r"))
+
+  data_payload = read_expected("expected_data.lst")
+  
+  datayield = 0
+  for src in sources:
+    pk_ok = check_data(src, sources[src], data_payload)
+    print("%d: %d (%d ok) packets" % (src, len(sources[src]), pk_ok))
+    datayield = datayield + pk_ok
+    
+  datayield = float(datayield) / (len(nodes) * 200.0)
+  kpi_datayield = datayield
+  print("Data Yield: %0.2f %% (%0.2f)" % (100 * datayield, kpi_datayield))
+
+  if len(counters) > 0:
+    print("Protocol counters:")
+    print("%4s " % 'node' + " ".join(["%16s" % name for name in counter_names]))
+    for node in sorted(counters):
+      print("%4d " % node + " ".join(["%16d" % value for value in counters[node]]))
+  
+  if powerfile is not None:
+    currents = read_power(ppf, sinknode)
+    avg_current = sum(currents.values()) / float(len(currents))
+    kpi_current = 1 - (avg_current / 25.0)
+    print("Average Current Drain: %0.2f mA (%0.2f)" % (avg_current, kpi_current))
+    print("Performance Metric: %0.2f" % (kpi_current * 0.5 + kpi_datayield * 0.5))
+
+def read_sources(inf, sinknode):
+  # packets printed by the sink, as sources[src][seq] = data
   sources={}
-  line = inf.readline()
-  while line != '':
+  for line in inf:
     if line[0]=='#':
-      line = inf.readline()
       continue
     #print line
     #(ts, obs, id, dir, tag, src, seq, data) = line[0:-1].split(',', 7)
@@ -46,7 +79,7 @@ def main(argv):
     if int(obs) == int(sinknode):
       if "Pkt:" in pkt:
         (tag, pkt) = pkt.split('Pkt:')
-        (src, seq, data) = pkt[0:-1].split(',', 2)
+        (src, seq, data) = pkt.rstrip().split(',', 2)
         src = int(src)
         seq = int(seq)
         data = int(data)
@@ -54,48 +87,42 @@ def main(argv):
           if not src in sources:
             sources[src] = {}
           sources[src][seq] = data
-  
-    line = inf.readline()
-    
-  #inf.close()
+  return sources
 
+def read_counters(inf):
+  # "Cnt:" line printed by every node at the end of the run, as counters[node] = [values]
+  counters = {}
+  for line in inf:
+    if line[0]=='#' or not "Cnt:" in line:
+      continue
+    (tag, cnt) = line.split('Cnt:', 1)
+    values = [int(value) for value in cnt.rstrip().split(',')]
+    if len(values) == len(counter_names) + 1 and values[0] in nodes:
+      counters[values[0]] = values[1:]
+  return counters
+
+def read_expected(filename):
   index = 0
   data_payload={}
-  sdf = open("expected_data.lst", "r")
+  sdf = open(filename, "r")
   line = sdf.readline()
   while line != '':
     #print line
     index = index + 1
     data_payload[index] = int(line)
     line = sdf.readline()
-  
-  datayield = 0
-  for src in sources:
-    pk_ok = check_data(src, sources[src], data_payload)
-    print "%d: %d (%d ok) packets" % (src, len(sources[src]), pk_ok)
-    datayield = datayield + pk_ok
-    
-  datayield = float(datayield) / (len(nodes) * 200.0)
-  kpi_datayield = datayield
-  print "Data Yield: %0.2f %% (%0.2f)" % (100 * datayield, kpi_datayield)
-  
-  if powerfile is not None:
-    sumcurrent = 0.0
-    numnodes = 0
-    line = ppf.readline()
-    while line != '':
-      if line[0]=='#':
-        line = ppf.readline()
-        continue
-      (obs, id, current) = line[0:-1].split(',', 3)
-      if int(obs) in nodes and int(obs)!=int(sinknode):
-        numnodes = numnodes + 1
-        sumcurrent = sumcurrent + float(current)
-      line = ppf.readline()
-    avg_current = sumcurrent / float(numnodes)
-    kpi_current = 1 - (avg_current / 25.0)
-    print "Average Current Drain: %0.2f mA (%0.2f)" % (avg_current, kpi_current)
-    print "Performance Metric: %0.2f" % (kpi_current * 0.5 + kpi_datayield * 0.5)
+  return data_payload
+
+def read_power(ppf, sinknode):
+  # average current per node in mA, the sink is excluded
+  currents = {}
+  for line in ppf:
+    if line[0]=='#':
+      continue
+    (obs, id, current) = line.rstrip().split(',', 3)
+    if int(obs) in nodes and int(obs)!=int(sinknode):
+      currents[int(obs)] = float(current)
+  return currents
   
 def check_data(src, pktlist, data_payload):
   pk_ok = 0
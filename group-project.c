@@ -41,15 +41,22 @@
 #include "clock.h"
 /* radio */
 #include "basic-radio.h"
+#ifdef PLATFORM_DPP_CC430
+#include "rf1a.h"
+#elif defined PLATFORM_SKY
+#include "cc2420.h"
+#endif /* PLATFORM_DPP_CC430 */
 /* data generator */
 #include "data-generator.h"
 #include "rtimer-ext.h"
+#include "sys/int-master.h"
 /*---------------------------------------------------------------------------*/
 /* Log configuration */
 #include "sys/log.h"
 #define LOG_MODULE    "DesignProjectApp"
 #define LOG_LEVEL LOG_LEVEL_MAIN
 #include <stdio.h> /* For printf() */
+#include <string.h> /* For memcpy() */
 /*---------------------------------------------------------------------------*/
 /* Makefile variables */
 #ifndef DATARATE
@@ -71,6 +78,24 @@ static volatile uint8_t i = 0;
 static volatile uint8_t	j = 0;
 static volatile rtimer_ext_clock_t t_zero = 0;
 static volatile uint8_t sync = 10;						/* in minimum 3 rounds */
+static volatile uint8_t round_count = 0;					/* rounds since t_zero */
+/*---------------------------------------------------------------------------*/
+/* Shared slot schedule */
+#define SLOT_COUNT			28								/* positions in slot_mapping, 0 is the join slot */
+#define ROUND_SLOTS			10								/* slots per round: the join slot and 9 shared slots */
+#define STOP_ROUNDS			((5 * SLOT_COUNT) / ROUND_SLOTS)	/* rounds after our last reading before we stop */
+/* Join of late-booting or rebooted nodes */
+#define JOIN_SLOT			0								/* free slot, parents listen for join requests */
+#define JOIN_PERIOD			32								/* rounds between two join slots, divides 256 */
+#define JOIN_SCAN_AFTER		30								/* sync listens before scanning all channels */
+#define JOIN_RX_OFFSET		(RTIMER_EXT_SECOND_LF / 400)	/* slot start to end of frame reception */
+#define DISC_MAX_ROUNDS		8								/* discovery rounds before an unlisted node joins instead */
+/* Slot skipping of idle sources */
+#define IDLE_MAX_ROUNDS		((8 * SLOT_COUNT) / ROUND_SLOTS)	/* max. rounds a source waits for a full block */
+#define JOIN_NONE			0
+#define JOIN_REQUEST		1
+#define JOIN_WAIT			2
+#define JOIN_SCAN			3
 /*---------------------------------------------------------------------------*/
 
 /* Structs for the different packets */
@@ -89,18 +114,50 @@ typedef struct {
 	uint16_t					src_id[4];
 	uint8_t						seqn[20];
 	uint16_t					payload[20];
+	uint16_t					join_ack;				// node accepted as new child, 0 if none
 	uint8_t 					size;
+	uint8_t						slot;					// slot of the sender
+	uint8_t						round;					// round of the sender
+	uint8_t						dst;					// parent of the sender, 0 for the static tree
+	uint8_t						backup;					// backup parent of the sender, 0 if none
+	uint8_t						hops;					// hops of the sender to the sink
+	uint8_t						next_round;				// round of the sender's next frame
+	uint8_t						join_open;				// round the sender listens in the join slot, 0 if none
 } lpsd_superpacket_t;
 // Network discovery packet
 typedef struct {
 	uint16_t					src_id;					// sender of this message
 	uint16_t					dst_id;					// target of this sender
 	uint8_t 					my_childs[5];				// selection of childs
+	uint8_t						hops;					// hops of the sender to the sink
 	
 } lpsd_discovery_t;
-// Writing queue
-QUEUE(writing_queue);
-MEMB(writing_memb, lpsd_packet_queue_t, 250);
+// Protocol counters, printed once at the end of the run
+typedef struct {
+	uint16_t					rx;						// frames received in a receive slot
+	uint16_t					rx_missed;				// receive slots without a valid frame
+	uint16_t					tx;						// frames sent in our slot
+	uint16_t					merge_dropped;			// received blocks not merged, superpacket full
+	uint16_t					alloc_failed;			// no receive buffer available
+	uint16_t					gen_overflow;			// readings dropped by the data generator, queue full
+	uint16_t					gen_unsent;				// readings still queued at the end, never popped
+	uint8_t						sync_heard;				// sync packets received
+	uint8_t						join_retries;			// join requests without acknowledgement
+	uint16_t					backup_forwarded;		// blocks forwarded as backup parent
+	uint16_t					tx_skipped;				// own slots without transmission
+	uint16_t					rx_skipped;				// receive slots skipped on announcement
+} lpsd_counters_t;
+#define COUNT(c)				(++counters.c)
+// Receive buffer, a received frame stays here until all readings are printed
+typedef struct rx_buffer {
+	struct rx_buffer*			next;
+	lpsd_superpacket_t			frame;
+	uint8_t						read_block;				// next block to print
+	uint8_t						read_counter;			// next reading within the block
+} lpsd_rx_buffer_t;
+// Receive queue, holds the buffers the sink still has to print
+QUEUE(rx_queue);
+MEMB(rx_memb, lpsd_rx_buffer_t, RX_BUFFER_COUNT);
 /*---------------------------------------------------------------------------*/
 /* --- Packets --- */
 //Syncronization Packet
@@ -112,7 +169,6 @@ static lpsd_discovery_t		disc_packet_rcv;
 //Normal Packet
 static volatile lpsd_superpacket_t	packet;							/* packet pointer */
 static volatile lpsd_packet_t*		pop_packet;						/* packet pointer */
-static volatile lpsd_superpacket_t	packet_rcv;						/* received packet buffer */
 static uint8_t				packet_len;						/* packet length, in Bytes */
 static uint16_t				timeout_ms;						/* packet receive timeout, in ms */
 static uint8_t				firstpacket;					/* First packet for the initiator */
@@ -127,28 +183,346 @@ static volatile uint8_t				stop;
 static volatile uint8_t				seqn;
 
 static volatile uint8_t				my_slot;						/* used slot ID */
-static volatile uint8_t				slot_mapping[28];
-static volatile uint8_t				slots[28];
+static volatile uint8_t				slot_mapping[SLOT_COUNT];
+static volatile uint8_t				slots[SLOT_COUNT];				/* positions we listen to */
+/* Shared slot and channel index of every position: in each shared slot three nodes
+ * send at the same time on different channels. No node of the Scenario 1 tree shares
+ * a slot with its parent or a sibling, discovery only picks children that keep it so. */
+static const uint8_t				data_slot[SLOT_COUNT] = {
+	0, 3, 1, 4, 2, 7, 4, 1, 2, 4, 5, 5, 3, 2, 6, 8, 6, 7, 9, 7, 8, 8, 9, 9, 5, 6, 1, 3 };
+static const uint8_t				data_channel[SLOT_COUNT] = {
+	0, 1, 3, 1, 2, 1, 2, 2, 1, 3, 3, 1, 2, 3, 1, 2, 2, 2, 3, 3, 3, 1, 1, 2, 2, 3, 1, 3 };
+static volatile uint8_t				listen_pos[ROUND_SLOTS];		/* position we listen to per shared slot, 0 if none */
+static volatile uint8_t				slot_pos;						/* position of the current receive slot */
+static volatile uint8_t				disc_slot = 0;					/* discovery slot, counted across rounds */
+static volatile uint8_t				disc_rounds = 0;				/* completed discovery rounds */
+static volatile uint8_t				sink_pos = 0;					/* position of the sink, heard in the first round */
+static volatile uint8_t				relay = 0;						/* we listen to at least one child */
 static volatile uint8_t				send;
 static volatile uint8_t				receive;
 static volatile uint8_t				receive_sink;
+static volatile uint8_t				print_sink;						/* readings the sink prints in an idle slot */
 static volatile uint8_t 			do_discovery = 0;
 static volatile uint8_t				first_round = 1;
 static volatile uint8_t 			sink_connection = 0;
 static volatile uint8_t 			peers[5];
 static volatile uint8_t 			peer_counter = 0;
+static const uint8_t				rf_channels[RF_CHANNEL_COUNT] = RF_CHANNEL_LIST;
+static volatile uint8_t				rx_channel = 0;					/* channel index the radio is tuned to */
+static volatile uint8_t				join_state = JOIN_NONE;
+static volatile uint8_t				join_round;						/* round in which we acquired sync */
+static rtimer_ext_clock_t			join_round_start;				/* start of the parent's round we synced on */
+static volatile uint8_t				parent_slot;					/* slot of the parent we join */
+static volatile uint8_t				send_join;
+static volatile uint8_t				receive_join;
+static volatile uint8_t				receive_ack;
+static volatile uint8_t				send_beacon;
+static volatile uint8_t				join_listen = 0;				/* announced join slot round, 0 if none */
+static volatile uint8_t				join_target;					/* join slot round of the parent we join */
+static lpsd_counters_t				counters;
+/* candidate parents from discovery, ranked by hops */
+#define CANDIDATE_COUNT		3
+static uint8_t						cand_id[CANDIDATE_COUNT];
+static uint8_t						cand_hops[CANDIDATE_COUNT];
+static uint8_t						cand_counter = 0;
+static uint8_t						fwd_seqn[34];					/* newest block forwarded per source */
+static volatile uint8_t				skip_until[SLOT_COUNT];			/* announced next frame per slot, 0 if none */
+static volatile uint8_t				next_tx_round = 0;				/* our announced next frame, 0 if none */
+static volatile uint8_t				idle_rounds = 0;
+static uint16_t						reading_ticks;					/* LF ticks between two readings */
+static lpsd_rx_buffer_t* volatile	backup_buf = NULL;				/* overheard frame held as backup parent */
+static volatile uint8_t				watch_pos = 0;					/* position of the primary parent of backup_buf */
 
 /* Functions */
+void schedule_sync_timer(void);
+void print_counters(void)
+{
+	// parsed by flocklab2metric.py, keep the order of lpsd_counters_t
+	// the generator losses are read here, they cover both backends and the end of the run
+	counters.gen_overflow = data_overflow_count();
+	counters.gen_unsent = data_queue_length();
+	LOG_INFO("Cnt:%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u\n", node_id, counters.rx, counters.rx_missed, counters.tx,
+			 counters.merge_dropped, counters.alloc_failed, counters.gen_overflow, counters.gen_unsent,
+			 counters.sync_heard, counters.join_retries,
+			 counters.backup_forwarded, counters.tx_skipped, counters.rx_skipped);
+}
+uint8_t waiting_for(volatile uint8_t* until)
+{
+	// true before the announced round, the announcement is cleared once it is reached
+	if(*until && (int8_t)(*until - round_count) > 0) {
+		return 1;
+	}
+	*until = 0;
+	return 0;
+}
+uint8_t skip_transmission(uint16_t queued)
+{
+	// never before the round we announced, our parent does not listen
+	if(waiting_for(&next_tx_round)) {
+		return 1;
+	}
+	// forwarded blocks and join acknowledgements always go out
+	if(packet.size > 1 || packet.join_ack) {
+		return 0;
+	}
+	// wait for a full block, but not forever
+	if(queued >= 5 || (queued > 0 && idle_rounds >= IDLE_MAX_ROUNDS)) {
+		return 0;
+	}
+	return 1;
+}
+uint8_t announce_next_round(void)
+{
+	uint16_t queued = data_queue_length();
+	uint32_t round_ticks = (uint32_t) sync_time;
+	uint8_t wait = 1;
+	// sources without children announce the round their next block is full, relays forward every round
+	if(!relay && queued < 5) {
+		wait = (((uint32_t) (5 - queued) * reading_ticks) + round_ticks - 1) / round_ticks;
+		if(wait > IDLE_MAX_ROUNDS) {
+			wait = IDLE_MAX_ROUNDS;
+		}
+	}
+	return round_count + wait;
+}
+uint8_t next_join_round(void)
+{
+	// join slots are in the last round of every period, never round 0
+	uint8_t round = round_count + (JOIN_PERIOD - 1) - (round_count % JOIN_PERIOD);
+	if(round == round_count) {
+		round += JOIN_PERIOD;
+	}
+	return round;
+}
+uint8_t join_candidate(lpsd_superpacket_t* frame)
+{
+	// the static tree takes any frame for sync, discovery needs a sender that listens for our request
+	if(sinkaddress == 22) {
+		return 1;
+	}
+	return frame->join_open && frame->slot < SLOT_COUNT && data_slot[frame->slot] != data_slot[my_slot];
+}
+void add_candidate(lpsd_discovery_t* disc)
+{
+	// insert sorted by hops, the last one falls out if the list is full
+	uint8_t k = cand_counter;
+	if(k == CANDIDATE_COUNT) {
+		if(disc->hops >= cand_hops[k - 1]) {
+			return;
+		}
+		--k;
+	} else {
+		++cand_counter;
+	}
+	while(k > 0 && cand_hops[k - 1] > disc->hops) {
+		cand_id[k] = cand_id[k - 1];
+		cand_hops[k] = cand_hops[k - 1];
+		--k;
+	}
+	cand_id[k] = disc->src_id;
+	cand_hops[k] = disc->hops;
+}
+uint8_t select_backup(void)
+{
+	// best candidate besides our parent that is closer to the sink
+	uint8_t k = 0;
+	while(k < cand_counter) {
+		if(cand_id[k] != disc_packet.dst_id && cand_hops[k] < disc_packet.hops) {
+			return cand_id[k];
+		}
+		++k;
+	}
+	return 0;
+}
+uint8_t position_of(uint16_t id)
+{
+	uint8_t k = 1;
+	while(k < SLOT_COUNT) {
+		if(slot_mapping[k] == id) {
+			return k;
+		}
+		++k;
+	}
+	return 0;
+}
+uint8_t slot_usable(uint8_t pos)
+{
+	// we cannot listen while we send, nor to two positions in the same shared slot
+	uint8_t k = 1;
+	if(node_id != sinkaddress && data_slot[pos] == data_slot[my_slot]) {
+		return 0;
+	}
+	while(k < SLOT_COUNT) {
+		if(slots[k] && k != my_slot && data_slot[k] == data_slot[pos]) {
+			return 0;
+		}
+		++k;
+	}
+	return 1;
+}
+void update_listen_slots(void)
+{
+	// one position per shared slot, the first one wins if two of them collide
+	uint8_t table[ROUND_SLOTS];
+	uint8_t children = 0;
+	uint8_t k = 1;
+	memset(table, 0, sizeof(table));
+	while(k < SLOT_COUNT) {
+		if(slots[k] && k != my_slot && (node_id == sinkaddress || data_slot[k] != data_slot[my_slot])
+		   && table[data_slot[k]] == 0) {
+			table[data_slot[k]] = k;
+			children = 1;
+		}
+		++k;
+	}
+	/* the slot ISR reads the table, it must never see it half built */
+	int_master_status_t status = int_master_read_and_disable();
+	memcpy((void*)listen_pos, table, sizeof(table));
+	relay = children;
+	int_master_status_set(status);
+}
+uint8_t carries_block(lpsd_superpacket_t* frame, uint16_t src_id, uint8_t first_seqn)
+{
+	uint8_t k = 0;
+	while(k < frame->size && k < 4) {
+		if(frame->src_id[k] == src_id && frame->seqn[k * 5] == first_seqn) {
+			return 1;
+		}
+		++k;
+	}
+	return 0;
+}
+uint8_t merge_blocks(lpsd_superpacket_t* frame, uint8_t backup, lpsd_superpacket_t* primary)
+{
+	/* append the blocks of a frame, as backup parent only those neither we nor the primary parent hold */
+	uint8_t rec_size = frame->size;
+	while(rec_size > 0 && packet.size < 4) {
+		--rec_size;
+		uint8_t read_val = rec_size * 5;
+		uint8_t write_val = packet.size * 5;
+		uint16_t src_id = frame->src_id[rec_size];
+		uint8_t first_seqn = frame->seqn[read_val];
+
+		if(src_id <= 33) {
+			if(backup) {
+				if(first_seqn <= fwd_seqn[src_id] || (primary != NULL && carries_block(primary, src_id, first_seqn))) {
+					continue;
+				}
+				COUNT(backup_forwarded);
+			}
+			if(first_seqn > fwd_seqn[src_id]) {
+				fwd_seqn[src_id] = first_seqn;
+			}
+		}
+		packet.src_id[packet.size] = src_id;
+		memcpy((void*)&packet.seqn[write_val], &frame->seqn[read_val], 5 * sizeof(uint8_t));
+		memcpy((void*)&packet.payload[write_val], &frame->payload[read_val], 5 * sizeof(uint16_t));
+		if(seqn == 200) ++stop;
+		++packet.size;
+	}
+	return rec_size;
+}
+void resolve_backup(lpsd_superpacket_t* primary)
+{
+	// the primary parent sends everything it merged in its next frame, a silent slot means it holds nothing
+	counters.merge_dropped += merge_blocks(&backup_buf->frame, 1, primary);
+	memb_free(&rx_memb, backup_buf);
+	backup_buf = NULL;
+}
+void set_channel(uint8_t channel)
+{
+	if(channel != rx_channel) {
+		RADIO_SET_CHANNEL(rf_channels[channel]);
+		rx_channel = channel;
+	}
+}
+uint8_t print_rx_readings(uint8_t max)
+{
+	uint8_t printed = 0;
+	while(*rx_queue != NULL && printed < max) {
+		lpsd_rx_buffer_t* buf = queue_peek(rx_queue);
+		while(buf->read_block < buf->frame.size && printed < max) {
+			uint8_t read_val = (buf->read_block * 5) + buf->read_counter;
+			uint16_t src_id = buf->frame.src_id[buf->read_block];
+			if(buf->frame.seqn[read_val] && src_id <= 33) {
+				LOG_INFO("Pkt:%u,%u,%u\n", src_id, buf->frame.seqn[read_val], buf->frame.payload[read_val]);
+				++printed;
+			}
+			// the first reading of every block was printed on reception
+			if(++buf->read_counter == 5) {
+				buf->read_counter = 1;
+				++buf->read_block;
+			}
+		}
+		if(buf->read_block >= buf->frame.size) {
+			// dequeue and release the buffer
+			queue_dequeue(rx_queue);
+			memb_free(&rx_memb, buf);
+		}
+	}
+	return printed;
+}
+uint8_t append_rx_frame(lpsd_rx_buffer_t* buf)
+{
+	// move the blocks of a short frame into the last queued buffer, if they fit
+	lpsd_rx_buffer_t* tail = list_tail(rx_queue);
+	if(tail == NULL || tail->frame.size + buf->frame.size > 4) {
+		return 0;
+	}
+	memcpy(&tail->frame.src_id[tail->frame.size], &buf->frame.src_id[0], buf->frame.size * sizeof(uint16_t));
+	memcpy(&tail->frame.seqn[tail->frame.size * 5], &buf->frame.seqn[0], buf->frame.size * 5 * sizeof(uint8_t));
+	memcpy(&tail->frame.payload[tail->frame.size * 5], &buf->frame.payload[0], buf->frame.size * 5 * sizeof(uint16_t));
+	tail->frame.size += buf->frame.size;
+	return 1;
+}
+void join_network(lpsd_superpacket_t* frame)
+{
+	/* the frame was sent at the start of its slot, derive the start of the next-but-one round */
+	join_round_start = rtimer_ext_now_lf() - JOIN_RX_OFFSET - ((uint64_t) data_slot[frame->slot] * slot_time);
+	t_zero = join_round_start + 2 * sync_time;
+	round_count = frame->round + 1;
+	join_round = round_count;
+	parent_slot = frame->slot;
+	join_target = frame->join_open;
+	disc_packet.dst_id = frame->src_id[0];
+	disc_packet.hops = frame->hops + 1;
+	join_state = JOIN_REQUEST;
+	sync = 0;
+	LOG_INFO("Sync acquired from %u in round %u\n", slot_mapping[parent_slot], frame->round);
+	schedule_sync_timer();
+}
+void scan_for_parent(void)
+{
+	/* listen on all channels for a relay's frame or the sink's beacon that opens a join slot */
+	lpsd_rx_buffer_t* buf = memb_alloc(&rx_memb);
+	while(buf != NULL) {
+		packet_len = radio_rcv(((uint8_t*)&buf->frame), 100);
+		if(packet_len == sizeof(lpsd_superpacket_t) && join_candidate(&buf->frame)) {
+			join_network(&buf->frame);
+			memb_free(&rx_memb, buf);
+			return;
+		}
+		set_channel((rx_channel + 1) % RF_CHANNEL_COUNT);
+	}
+}
+void joined(void)
+{
+	join_state = JOIN_NONE;
+	LOG_INFO("Joined: parent %u, %u rounds, %lu ms after boot\n", disc_packet.dst_id, (uint8_t)(round_count - join_round),
+			 (unsigned long)(rtimer_ext_now_lf() * 1000 / RTIMER_EXT_SECOND_LF));
+}
 void reset_sync_timer(void)
 {
 	radio_rcv(((uint8_t*)&sync_packet_rcv), 1);
 	i = 0;
+	++round_count;
 }
 void reset_slot_timer(void)
 {	
 	if(do_discovery){
-		j = i;
-		if(my_slot == i){
+		/* discovery keeps one exclusive slot per position, counted across rounds */
+		j = disc_slot;
+		if(my_slot == j){
 			send = 1;
 			receive = 0;
 			//LOG_INFO("My slot j:%u\n",j);
@@ -158,10 +532,14 @@ void reset_slot_timer(void)
 			//LOG_INFO("First round j:%u\n",j);
 
 			
-		}else if(slots[i]){
+		}else if(slots[j] || j == sink_pos){
 			receive = 1;
 			//LOG_INFO("Slots j:%u\n",j);
 		}
+		if(++disc_slot == SLOT_COUNT) {
+			disc_slot = 0;
+			++disc_rounds;
+		}
 
 	}else if(node_id == sinkaddress) {
 		if(is_data_in_queue()) {
@@ -171,36 +549,54 @@ void reset_slot_timer(void)
 			seqn = pop_packet->seqn;
 			LOG_INFO("Pkt:%u,%u,%u\n", pop_packet->src_id,pop_packet->seqn, pop_packet->payload);
 		}
-		if(my_slot == i) {
-			uint8_t break_counter = 0;
-			while(*writing_queue != NULL && break_counter < 4) {
-				// dequeue the first packet
-	  			lpsd_packet_queue_t* pkt = queue_dequeue(writing_queue);
-	  			// free the memory block
-	  			memb_free(&writing_memb, pkt);
-
-	  			LOG_INFO("Pkt:%u,%u,%u\n", pkt->src_id,pkt->seqn, pkt->payload);
-	  			++break_counter;
-			}
-			if(seqn == 200) ++stop;
-		} else {
+		slot_pos = (i < ROUND_SLOTS) ? listen_pos[i] : 0;
+		if(slot_pos && waiting_for(&skip_until[slot_pos])) {
+			COUNT(rx_skipped);
+			slot_pos = 0;
+		}
+		if(i == JOIN_SLOT && (round_count % JOIN_PERIOD) == JOIN_PERIOD / 2) {
+			/* beacon for nodes that only hear the sink, it announces our next join slot */
+			packet.size = 0;
+			packet.src_id[0] = node_id;
+			packet.slot = JOIN_SLOT;
+			packet.round = round_count;
+			packet.hops = 0;
+			packet.next_round = 0;
+			packet.join_open = (sinkaddress == 22) ? 0 : next_join_round();
+			join_listen = packet.join_open;
+			send_beacon = 1;
+		} else if(i == JOIN_SLOT && join_listen && round_count == join_listen) {
+			join_listen = 0;
+			receive_join = 1;
+		} else if(slot_pos) {
 			receive_sink = 1;
+		} else {
+			// no child sends in this slot, the main loop prints, it owns rx_queue and rx_memb
+			print_sink = 4;
+		}
+		if(i == data_slot[my_slot] && seqn == 200) ++stop;
+	} else if(join_state) {
+		if(join_state == JOIN_REQUEST && i == JOIN_SLOT && round_count == join_target) {
+			send_join = 1;
+		} else if(join_state == JOIN_WAIT && i == data_slot[parent_slot]) {
+			receive_ack = 1;
 		}
 	} else {
-		if(i < 28 && slots[i]) {
-			if(my_slot == i) {
-				uint8_t counter = 0;
-				packet.src_id[0] = pop_packet->src_id;
-				while(is_data_in_queue() && counter < 5) {
-					pop_packet = pop_data();
-
-					//LOG_INFO("POP Pkt:%u,%u,%u\n", pop_packet->src_id,pop_packet->seqn, pop_packet->payload);
-
-					packet.seqn[counter] = pop_packet->seqn;
-					packet.payload[counter] = pop_packet->payload;
-					seqn = pop_packet->seqn;
-
-					++counter;
+		if(i == JOIN_SLOT) {
+			// only in join slots we announced, leaves never listen here
+			if(join_listen && round_count == join_listen) {
+				join_listen = 0;
+				receive_join = 1;
+			}
+		} else if(i == data_slot[my_slot]) {
+			if(skip_transmission(data_queue_length())) {
+				++idle_rounds;
+				COUNT(tx_skipped);
+			} else {
+				packet.src_id[0] = node_id;
+				uint8_t counter = pop_data_n((uint8_t*)&packet.seqn[0], (uint16_t*)&packet.payload[0], 5);
+				if(counter) {
+					seqn = packet.seqn[counter - 1];
 				}
 				while(counter < 5) {
 					packet.seqn[counter] = 0;
@@ -208,10 +604,30 @@ void reset_slot_timer(void)
 
 					++counter;
 				}
-				if(seqn == 200) ++stop;
+				packet.slot = my_slot;
+				packet.round = round_count;
+				next_tx_round = announce_next_round();
+				packet.next_round = next_tx_round;
+				if(relay && sinkaddress != 22) {
+					/* parents of the static tree listen in our slot, no join slot needed there */
+					packet.join_open = next_join_round();
+					join_listen = packet.join_open;
+				} else {
+					/* no child left, do not announce a join slot nobody listens in */
+					packet.join_open = 0;
+					join_listen = 0;
+				}
+				idle_rounds = 0;
 				// --- SOURCE ---
 				send = 1;
-			} else if(my_slot != i) {
+			}
+			if(seqn == 200) ++stop;
+		} else if(i < ROUND_SLOTS && (listen_pos[i] || (backup_buf != NULL && i == data_slot[watch_pos]))) {
+			/* as backup parent we also listen to the primary parent while we hold a frame */
+			slot_pos = listen_pos[i] ? listen_pos[i] : watch_pos;
+			if(waiting_for(&skip_until[slot_pos])) {
+				COUNT(rx_skipped);
+			} else {
 				receive = 1;
 			}
 		}
@@ -223,18 +639,32 @@ void reset_slot_timer(void)
 void schedule_sync_timer(void)
 {
 	if(t_zero == 0) {
+		if(first_time == 0) {
+			/* no sync packet heard, the node joins from the data slots later */
+			return;
+		}
 		rtimer_ext_clock_t delta_t = (last_time - first_time) / (uint64_t) (last_sync - first_sync);
 		t_zero = first_time - ((uint64_t) first_sync * delta_t);
 	}
 	LOG_INFO("T_ZERO: %u\n",(uint16_t) t_zero);
-	rtimer_ext_reset();
+	if(join_state == JOIN_NONE) {
+		/* t_zero of a joining node is in the running clock, keep it and the data generator going */
+		rtimer_ext_reset();
+	}
 	rtimer_ext_schedule(RTIMER_EXT_LF_1, t_zero, sync_time, (rtimer_ext_callback_t) &reset_sync_timer);
-	rtimer_ext_schedule(RTIMER_EXT_LF_2, t_zero + RTIMER_EXT_SECOND_LF, slot_time, (rtimer_ext_callback_t) &reset_slot_timer);
+	/* the first slot starts on a round boundary, at least one second after t_zero */
+	rtimer_ext_schedule(RTIMER_EXT_LF_2, t_zero + ((RTIMER_EXT_SECOND_LF + sync_time - 1) / sync_time) * sync_time, slot_time,
+						(rtimer_ext_callback_t) &reset_slot_timer);
 	rtimer_ext_clock_t exp_time;
 	rtimer_ext_next_expiration(RTIMER_EXT_LF_2, &exp_time);
+	if(join_state && (exp_time - join_round_start) % sync_time != 0) {
+		/* our slot 0 must start a round of the parent, or we miss its data slot */
+		LOG_INFO("Join schedule off by %lu ticks\n", (unsigned long)((exp_time - join_round_start) % sync_time));
+	}
 
 	if(sync) {
 		LOG_INFO("Not synced --> calculated t_zero with less cycles.");
+		print_counters();
 		LPM4;
 		sync = 0;
 	}
@@ -249,12 +679,12 @@ PROCESS_THREAD(design_project_process, ev, data)
 	PROCESS_BEGIN();
 
 	if(datarate == 1) {
-		sync_time = RTIMER_EXT_SECOND_LF;
 		slot_time = RTIMER_EXT_SECOND_LF/28;
 	} else {
-		sync_time = RTIMER_EXT_SECOND_LF/2;
 		slot_time = RTIMER_EXT_SECOND_LF/56;
 	}
+	sync_time = ROUND_SLOTS * slot_time;
+	reading_ticks = RTIMER_EXT_SECOND_LF / datarate;
 	
 	timeout_ms = 6;
 	firstpacket = 1;
@@ -268,6 +698,7 @@ PROCESS_THREAD(design_project_process, ev, data)
 	send = 0;
 	receive = 0;
 	receive_sink = 0;
+	print_sink = 0;
 
 	slot_mapping[1] = 8;
 	slot_mapping[2] = 2;
@@ -339,6 +770,7 @@ PROCESS_THREAD(design_project_process, ev, data)
 	disc_packet.my_childs[2] = 0;
 	disc_packet.my_childs[3] = 0;
 	disc_packet.my_childs[4] = 0;
+	disc_packet.hops = 0;
 
 	disc_packet_rcv.src_id = 0;
 	disc_packet_rcv.dst_id = 0;
@@ -347,10 +779,17 @@ PROCESS_THREAD(design_project_process, ev, data)
 	disc_packet_rcv.my_childs[2] = 0;
 	disc_packet_rcv.my_childs[3] = 0;
 	disc_packet_rcv.my_childs[4] = 0;
+	disc_packet_rcv.hops = 0;
+	packet.join_ack = 0;
+	packet.dst = 0;
+	packet.backup = 0;
+	packet.next_round = 0;
+	packet.join_open = 0;
+	send_beacon = 0;
 
-	/* initialize the writing queue */
-  	memb_init(&writing_memb);
-  	queue_init(writing_queue);
+	/* initialize the receive buffers */
+  	memb_init(&rx_memb);
+  	queue_init(rx_queue);
 
 	/* configure GPIO as outputs */
 	//PIN_CFG_OUT(RADIO_START_PIN);
@@ -365,7 +804,7 @@ PROCESS_THREAD(design_project_process, ev, data)
 
 	/* set my_slot */
 	i = 0;
-	while(i < 28) {
+	while(i < SLOT_COUNT) {
 		if(node_id == slot_mapping[i]) {
 			my_slot = i;
 			slots[i] = 1;
@@ -392,12 +831,29 @@ PROCESS_THREAD(design_project_process, ev, data)
 			/* --- FORWARDER --- */
 
 			//LOG_INFO("Listening...");
+			uint8_t listen_counter = 0;
+			lpsd_rx_buffer_t* buf = memb_alloc(&rx_memb);
 			while(1) {
-				packet_len = radio_rcv(((uint8_t*)&sync_packet_rcv), 100);
-				if(packet_len){
+				packet_len = radio_rcv(((uint8_t*)&buf->frame), 100);
+				if(packet_len == sizeof(lpsd_sync_t) || (packet_len == sizeof(lpsd_superpacket_t) && join_candidate(&buf->frame))) {
 					break;
 				}
+				/* booted late: look for data slots on all channels */
+				if(listen_counter < JOIN_SCAN_AFTER) {
+					++listen_counter;
+				} else {
+					set_channel((rx_channel + 1) % RF_CHANNEL_COUNT);
+				}
+			}
+			if(packet_len == sizeof(lpsd_superpacket_t)) {
+				/* the network is already running */
+				join_network(&buf->frame);
+				memb_free(&rx_memb, buf);
+				break;
 			}
+			memcpy(&sync_packet_rcv, &buf->frame, sizeof(lpsd_sync_t));
+			memb_free(&rx_memb, buf);
+			COUNT(sync_heard);
 
 			// wait 25 ms
 			clock_delay(5*1767);
@@ -425,7 +881,7 @@ PROCESS_THREAD(design_project_process, ev, data)
 		}
 	}
 
-	if(sync != -1) {
+	if(sync != -1 && join_state == JOIN_NONE) {
 		/* calculate t zero and set the sync_timer */
 		rtimer_ext_clock_t delta_t = (last_time - first_time) / (uint64_t) (last_sync - first_sync);
 		t_zero = first_time - ((uint64_t) first_sync * delta_t);
@@ -449,7 +905,24 @@ PROCESS_THREAD(design_project_process, ev, data)
 		} else if(node_id == 33) {
 			slots[7] = 1;				// 1
 			slots[4] = 1;				// 4
+		} else if(node_id == sinkaddress) {
+			slots[3] = 1;				// 3
+			slots[5] = 1;				// 6
+			slots[15] = 1;				// 18
+			slots[24] = 1;				// 28
+			slots[25] = 1;				// 16
 		}
+		/* the static tree needs no join request */
+		if(join_state) {
+			disc_packet.dst_id = sinkaddress;
+			joined();
+		}
+	} else if(join_state) {
+		/* --- Scenario 2, late node --- */
+		// the sender of the frame we synced on becomes our parent
+		packet.dst = disc_packet.dst_id;
+		packet.hops = disc_packet.hops;
+		LOG_INFO("Joining parent %u\n", disc_packet.dst_id);
 
 	} else {
 		/* --- Scenario 2 --- */
@@ -465,10 +938,10 @@ PROCESS_THREAD(design_project_process, ev, data)
 				if(packet_len)
 				{
 					if(disc_packet_rcv.src_id == sinkaddress){
-						sink_connection = 1;
-						disc_packet.dst_id = sinkaddress;
+						/* the sink lists the children it can listen to */
+						sink_pos = j;
 						LOG_INFO("Direct connection to sink\n");
-					}else if(peer_counter < 5){
+					}else if(peer_counter < 5 && slot_usable(j)){
 						slots[j] = 1;
 						peers[peer_counter] = disc_packet_rcv.src_id;
 						++peer_counter;
@@ -488,16 +961,22 @@ PROCESS_THREAD(design_project_process, ev, data)
 		}
 	}
 	while(do_discovery){
-		if(receive && !sink_connection){
+		if(receive){
 			packet_len = radio_rcv(((uint8_t*)&disc_packet_rcv), timeout_ms);
 			if(packet_len){
 				if(disc_packet_rcv.dst_id){
 					uint8_t k = 0;
 					while(k < 5){
 						if(disc_packet_rcv.my_childs[k] == node_id){
-							disc_packet.dst_id = disc_packet_rcv.src_id;
-							sink_connection = 1;
-							LOG_INFO("My Parent: %u\n", disc_packet.dst_id);
+							if(!sink_connection) {
+								disc_packet.dst_id = disc_packet_rcv.src_id;
+								disc_packet.hops = disc_packet_rcv.hops + 1;
+								sink_connection = 1;
+								LOG_INFO("My Parent: %u\n", disc_packet.dst_id);
+							} else {
+								/* a second parent listens in our slot as well, it can be our backup */
+								add_candidate(&disc_packet_rcv);
+							}
 						}
 						++k;
 					}
@@ -505,6 +984,17 @@ PROCESS_THREAD(design_project_process, ev, data)
 					
 			}
 			receive = 0;
+		} else if(!sink_connection && node_id != sinkaddress && disc_rounds >= DISC_MAX_ROUNDS) {
+			/* no parent listed us, join like a late node instead of waiting forever */
+			join_state = JOIN_SCAN;
+			do_discovery = 0;
+			send = 0;
+			receive = 0;
+			LOG_INFO("Discovery timed out\n");
+			scan_for_parent();
+			packet.dst = disc_packet.dst_id;
+			packet.hops = disc_packet.hops;
+			LOG_INFO("Joining parent %u\n", disc_packet.dst_id);
 		} else if(send){
 			uint8_t k = 0;
 			while(k < 5){
@@ -516,99 +1006,172 @@ PROCESS_THREAD(design_project_process, ev, data)
 			LOG_INFO("My Child 1: %u, 2: %u, 3: %u, 4: %u, 5: %u\n", peers[0], peers[1], peers[2], peers[3], peers[4]);
 			if(disc_packet.dst_id) {
 				do_discovery = 0;
-				LOG_INFO("Discovery completed\n");
+				packet.dst = disc_packet.dst_id;
+				packet.hops = disc_packet.hops;
+				packet.backup = select_backup();
+				LOG_INFO("Discovery completed, backup parent: %u\n", packet.backup);
 			}
 		}
 	}
-	while(stop < 5) {
+
+	/* every position sends on its own channel, receivers hop per slot */
+	update_listen_slots();
+	LOG_INFO("Slot: %u, channel: %u\n", data_slot[my_slot], rf_channels[data_channel[my_slot]]);
+	while(stop < STOP_ROUNDS) {
 		if(receive) {
-			packet_len = radio_rcv(((uint8_t*)&packet_rcv), timeout_ms);
-			if(packet_len) {
-				uint8_t rec_size = packet_rcv.size;
-				while(rec_size > 0 && packet.size < 4) {
-					uint8_t counter = 0;
-					while(counter < 5) {
-						uint8_t read_val = ((rec_size - 1) * 5) + counter;
-						uint8_t write_val = (packet.size * 5) + counter;
-						
-						packet.src_id[packet.size] = packet_rcv.src_id[(rec_size - 1)];
-						packet.seqn[write_val] = packet_rcv.seqn[read_val];
-						packet.payload[write_val] = packet_rcv.payload[read_val];
-						++counter;
+			lpsd_rx_buffer_t* buf = memb_alloc(&rx_memb);
+			if(buf != NULL) {
+				set_channel(data_channel[slot_pos]);
+				packet_len = radio_rcv(((uint8_t*)&buf->frame), timeout_ms);
+				if(packet_len == sizeof(lpsd_superpacket_t) && buf->frame.size <= 4) {
+					if(buf->frame.slot < SLOT_COUNT) {
+						skip_until[buf->frame.slot] = buf->frame.next_round;
+					}
+					COUNT(rx);
+					if(backup_buf != NULL && slot_pos == watch_pos) {
+						resolve_backup(&buf->frame);
+					}
+					if(buf->frame.dst == 0 || buf->frame.dst == node_id) {
+						/* append the blocks of our children */
+						counters.merge_dropped += merge_blocks(&buf->frame, 0, NULL);
+					} else if(buf->frame.backup == node_id && buf->frame.hops > disc_packet.hops) {
+						/* we are the backup parent, hold the frame until the next frame of the primary parent */
+						if(backup_buf != NULL) {
+							resolve_backup(NULL);
+						}
+						uint8_t pos = position_of(buf->frame.dst);
+						if(pos && slot_usable(pos)) {
+							watch_pos = pos;
+							backup_buf = buf;
+							buf = NULL;
+						}
+					} else if(slots[slot_pos] && slot_pos != my_slot) {
+						/* a peer that chose another parent, its slot stays idle for us */
+						slots[slot_pos] = 0;
+						update_listen_slots();
+					}
+				} else {
+					COUNT(rx_missed);
+					if(backup_buf != NULL && slot_pos == watch_pos) {
+						resolve_backup(NULL);
 					}
-					uint8_t read_val = ((rec_size - 1) * 5);
-					uint8_t write_val = (packet.size * 5);
-					packet.src_id[packet.size] = packet_rcv.src_id[(rec_size - 1)];
-					packet.seqn[write_val] = packet_rcv.seqn[read_val];
-					packet.payload[write_val] = packet_rcv.payload[read_val];
-					if(seqn == 200) ++stop;
-					--rec_size;
-					++packet.size;
 				}
+				if(buf != NULL) {
+					memb_free(&rx_memb, buf);
+				}
+			} else {
+				COUNT(alloc_failed);
 			}
 			receive = 0;
 		} else if(send) {
+			set_channel(data_channel[my_slot]);
 			radio_send(((uint8_t*)(&(packet.src_id[0]))),sizeof(lpsd_superpacket_t),1);
+			COUNT(tx);
 			send = 0;
 			packet.size = 1;
+			packet.join_ack = 0;
+		} else if(receive_join) {
+			/* join requests use the channel of our position, the sink's beacon channel at the sink */
+			set_channel(node_id == sinkaddress ? 0 : data_channel[my_slot]);
+			packet_len = radio_rcv(((uint8_t*)&disc_packet_rcv), timeout_ms);
+			if(packet_len == sizeof(lpsd_discovery_t) && disc_packet_rcv.dst_id == node_id) {
+				/* listen in the slot of the new child and acknowledge it in our next frame */
+				uint8_t k = position_of(disc_packet_rcv.src_id);
+				if(k && slots[k]) {
+					/* the child missed our acknowledgement and asks again */
+					packet.join_ack = disc_packet_rcv.src_id;
+				} else if(k && slot_usable(k)) {
+					slots[k] = 1;
+					update_listen_slots();
+					packet.join_ack = disc_packet_rcv.src_id;
+					LOG_INFO("New child: %u\n", disc_packet_rcv.src_id);
+				}
+			}
+			receive_join = 0;
+		} else if(send_join) {
+			/* parents listen for join requests on the channel of their position */
+			set_channel(data_channel[parent_slot]);
+			radio_send(((uint8_t*)&disc_packet),sizeof(disc_packet),1);
+			join_state = JOIN_WAIT;
+			send_join = 0;
+		} else if(send_beacon) {
+			set_channel(0);
+			radio_send(((uint8_t*)(&(packet.src_id[0]))),sizeof(lpsd_superpacket_t),1);
+			packet.join_ack = 0;
+			send_beacon = 0;
+		} else if(receive_ack) {
+			lpsd_rx_buffer_t* buf = memb_alloc(&rx_memb);
+			if(buf != NULL) {
+				set_channel(data_channel[parent_slot]);
+				packet_len = radio_rcv(((uint8_t*)&buf->frame), timeout_ms);
+				if(packet_len == sizeof(lpsd_superpacket_t) && buf->frame.join_ack == node_id) {
+					joined();
+				} else if(packet_len == sizeof(lpsd_superpacket_t) && buf->frame.join_open) {
+					/* retry in the join slot the parent announced */
+					join_target = buf->frame.join_open;
+					join_state = JOIN_REQUEST;
+					COUNT(join_retries);
+				}
+				memb_free(&rx_memb, buf);
+			} else {
+				COUNT(alloc_failed);
+			}
+			receive_ack = 0;
 		}
 		if(receive_sink) {
-			packet_len = radio_rcv(((uint8_t*)&packet_rcv), timeout_ms);
-			if(packet_len) {
-				uint8_t rec_size = packet_rcv.size;
-				lpsd_packet_queue_t* writing_pkt;
-				while(rec_size > 0) {
-					uint8_t counter = 0;
-					while(counter < 5) {
-						uint8_t read_val = ((rec_size - 1) * 5) + counter;
-						if(packet_rcv.seqn[read_val] && packet_rcv.src_id[(rec_size - 1)] <= 33) {
-							if(counter == 0) {
-								LOG_INFO("Pkt:%u,%u,%u\n", packet_rcv.src_id[(rec_size - 1)],packet_rcv.seqn[read_val], packet_rcv.payload[read_val]);
-							} else {
-								writing_pkt = memb_alloc(&writing_memb);
-								
-								writing_pkt->src_id   = packet_rcv.src_id[(rec_size - 1)];
-								writing_pkt->seqn     = packet_rcv.seqn[read_val];
-								writing_pkt->payload  = packet_rcv.payload[read_val];
-
-								// add packet to the queue
-								queue_enqueue(writing_queue, writing_pkt);
-							}
+			set_channel(data_channel[slot_pos]);
+			lpsd_rx_buffer_t* buf = memb_alloc(&rx_memb);
+			if(buf == NULL) {
+				/* all buffers in use, print as much as in a missed slot, the slot is lost if no buffer is released */
+				COUNT(alloc_failed);
+				print_rx_readings(3);
+				buf = memb_alloc(&rx_memb);
+			}
+			if(buf != NULL) {
+				packet_len = radio_rcv(((uint8_t*)&buf->frame), timeout_ms);
+				if(packet_len == sizeof(lpsd_superpacket_t) && buf->frame.size <= 4) {
+					/* print the first reading of every block now, the rest stays in the buffer */
+					uint8_t rec_size = buf->frame.size;
+					if(buf->frame.slot < SLOT_COUNT) {
+						skip_until[buf->frame.slot] = buf->frame.next_round;
+					}
+					COUNT(rx);
+					while(rec_size > 0) {
+						--rec_size;
+						uint8_t read_val = rec_size * 5;
+						if(buf->frame.seqn[read_val] && buf->frame.src_id[rec_size] <= 33) {
+							LOG_INFO("Pkt:%u,%u,%u\n", buf->frame.src_id[rec_size],buf->frame.seqn[read_val], buf->frame.payload[read_val]);
 						}
-						++counter;
 					}
-					--rec_size;
-				}
-			} else {
-				uint8_t counter = 0;
-				while(*writing_queue != NULL && counter < 3) {
-					/* dequeue the first packet */
-	  				lpsd_packet_queue_t* pkt = queue_dequeue(writing_queue);
-	  				/* free the memory block */
-	  				memb_free(&writing_memb, pkt);
-					if(pkt->src_id <= 33) {
-	  					LOG_INFO("Pkt:%u,%u,%u\n", pkt->src_id,pkt->seqn, pkt->payload);
+					if(append_rx_frame(buf)) {
+						memb_free(&rx_memb, buf);
+					} else {
+						buf->read_block = 0;
+						buf->read_counter = 1;
+						queue_enqueue(rx_queue, buf);
 					}
-					
-					++counter;
+				} else {
+					COUNT(rx_missed);
+					memb_free(&rx_memb, buf);
+					print_rx_readings(3);
 				}
 			}
 			receive_sink = 0;
 		}
+		if(print_sink) {
+			print_rx_readings(print_sink);
+			print_sink = 0;
+		}
 	}
 
 	if(node_id == sinkaddress) {
-		while(*writing_queue != NULL) {
-			/* dequeue the first packet */
-  			lpsd_packet_queue_t* pkt = queue_dequeue(writing_queue);
-  			/* free the memory block */
-  			memb_free(&writing_memb, pkt);
-			if(pkt->src_id <= 33) {
-  				LOG_INFO("Pkt:%u,%u,%u\n", pkt->src_id,pkt->seqn, pkt->payload);
-			}
+		while(*rx_queue != NULL) {
+			print_rx_readings(16);
 		}
+		print_counters();
 	} else {
 		LOG_INFO("no new packets --> going to LPM4.");
+		print_counters();
 		LPM4;
 	}
 
@@ -0,0 +1,222 @@
+#!/usr/bin/env python
+
+import sys, os, getopt
+
+def usage():
+  print("Usage: map2budget.py [-s <count>] <map-file> <budget-file>")
+  print("")
+  print("  -s <count>:    optional. also list the <count> largest symbols of each section")
+  print("  <map-file>:    linker map generated by the build, e.g. 'group-project-sky.map'")
+  print("  <budget-file>: optional. budget list, e.g. 'memory-budget.lst'. If any budget")
+  print("                 is exceeded, the script exits with a non-zero status")
+
+# output sections of the map file and the column of the size report they count
+# towards (same split as msp430-size: read-only data is part of the image)
+sections = {
+  '.text'    : 'text',
+  '.rodata'  : 'text',
+  '.vectors' : 'text',
+  '.data'    : 'data',
+  '.bss'     : 'bss',
+  '.noinit'  : 'bss',
+}
+
+##############################################################################
+#
+# Main
+#
+##############################################################################
+def main(argv):
+
+  numsymbols = 0
+
+  try:
+    (opts, args) = getopt.getopt(argv, "s:")
+  except getopt.GetoptError:
+    usage()
+    sys.exit(2)
+  for (opt, val) in opts:
+    if opt == '-s':
+      numsymbols = int(val)
+
+  if len(args) < 1:
+    usage()
+    sys.exit()
+
+  mapfile = args[0]
+  budgetfile = None
+  if len(args) > 1:
+    budgetfile = args[1]
+
+  (objects, symbols, totals) = parse_map(mapfile)
+
+  # the output section sizes are the reference, anything the input sections
+  # do not explain (alignment, linker script assignments) is listed separately
+  other = { 'text': 0, 'data': 0, 'bss': 0 }
+  for sec in totals:
+    other[sec] = totals[sec] - sum([objects[obj][sec] for obj in objects])
+  if other['text'] or other['data'] or other['bss']:
+    objects['(other)'] = other
+
+  print("Memory usage of %s" % os.path.basename(mapfile))
+  print("%8s %8s %8s %8s  %s" % ('text', 'data', 'bss', 'ram', 'object'))
+  for obj in sorted(objects, key=lambda o: -ram_of(objects[o]) * 0x10000 - rom_of(objects[o])):
+    print_line(objects[obj], obj)
+  print_line(totals, 'total')
+
+  if numsymbols > 0:
+    for sec in ['text', 'data', 'bss']:
+      print("")
+      print("Largest symbols in %s" % sec)
+      ranked = sorted(symbols[sec], key=lambda s: -s[2])
+      for (obj, sym, size) in ranked[0:numsymbols]:
+        print("%8d  %s (%s)" % (size, sym, obj))
+
+  if budgetfile is not None:
+    exceeded = check_budget(budgetfile, objects, totals)
+    if exceeded:
+      print("Memory budget check failed: %d problem(s)" % exceeded)
+      sys.exit(1)
+    print("Memory budget: ok")
+
+def ram_of(usage):
+  return usage['data'] + usage['bss']
+
+def rom_of(usage):
+  return usage['text'] + usage['data']
+
+def print_line(usage, name):
+  print("%8d %8d %8d %8d  %s" % (usage['text'], usage['data'], usage['bss'], ram_of(usage), name))
+
+def object_name(path):
+  # archive members are accounted to their archive, e.g. "contiki-ng-sky.a(memb.o)"
+  # becomes "contiki-ng-sky.a", object files of the project lose their obj_ directory
+  if '(' in path:
+    path = path.split('(', 1)[0]
+  return os.path.basename(path)
+
+def parse_map(mapfile):
+  objects = {}
+  symbols = { 'text': [], 'data': [], 'bss': [] }
+  totals = { 'text': 0, 'data': 0, 'bss': 0 }
+
+  inf = open(mapfile, "r")
+  lines = inf.readlines()
+  inf.close()
+
+  # skip everything before the actual memory map
+  index = 0
+  while index < len(lines) and not lines[index].startswith('Linker script and memory map'):
+    index = index + 1
+
+  current = None
+  pending = None
+  while index < len(lines):
+    line = lines[index].rstrip('\n')
+    index = index + 1
+    if line == '':
+      continue
+
+    # output section, e.g. ".bss            0x00001c5c      0xe8c load address ..."
+    if line[0] == '.':
+      fields = line.split()
+      current = sections.get(fields[0], None)
+      pending = None
+      if current is not None:
+        if len(fields) == 1 and index < len(lines):
+          # long section name, address and size follow on the next line
+          fields = fields + lines[index].split()
+          index = index + 1
+        if len(fields) >= 3 and fields[2].startswith('0x'):
+          totals[current] = totals[current] + int(fields[2], 16)
+      continue
+    if current is None or line[0] != ' ':
+      continue
+
+    fields = line.split()
+    # input section name on its own line, address and size follow on the next one
+    if len(fields) == 1 and line[1] != ' ' and not fields[0].startswith('*'):
+      pending = fields[0]
+      continue
+    if line[1] != ' ':
+      name = fields[0]
+      fields = fields[1:]
+    elif pending is not None:
+      name = pending
+    else:
+      # symbol or assignment inside an input section
+      continue
+    pending = None
+
+    if len(fields) < 3 or not fields[1].startswith('0x') or (name.startswith('*') and name != '*fill*'):
+      continue
+    size = int(fields[1], 16)
+    if size == 0:
+      continue
+    if name == '*fill*':
+      # alignment padding between input sections, e.g. " *fill*  0x00001c5b  0x1 00"
+      obj = '(fill)'
+    else:
+      obj = object_name(fields[2])
+    if not obj in objects:
+      objects[obj] = { 'text': 0, 'data': 0, 'bss': 0 }
+    objects[obj][current] = objects[obj][current] + size
+
+    if name == '*fill*':
+      continue
+    # with -ffunction-sections/-fdata-sections the input section carries the symbol name
+    sym = '(%s)' % name
+    for prefix in ['.text.', '.rodata.', '.data.', '.bss.', '.noinit.']:
+      if name.startswith(prefix):
+        sym = name[len(prefix):]
+    symbols[current].append((obj, sym, size))
+
+  return (objects, symbols, totals)
+
+def check_budget(budgetfile, objects, totals):
+  exceeded = 0
+  bdf = open(budgetfile, "r")
+  line = bdf.readline()
+  while line != '':
+    line = line.strip()
+    if line == '' or line[0] == '#':
+      line = bdf.readline()
+      continue
+    fields = line.split(',')
+    if len(fields) != 3 or not fields[2].strip().isdigit():
+      print("%s: malformed line '%s'" % (budgetfile, line))
+      exceeded = exceeded + 1
+      line = bdf.readline()
+      continue
+    (scope, sec, limit) = [f.strip() for f in fields]
+    limit = int(limit)
+    # a typo must not pass as an object without any usage
+    if scope == 'total':
+      usage = totals
+    elif scope in objects:
+      usage = objects[scope]
+    else:
+      print("%s: unknown object '%s' (not in the map)" % (budgetfile, scope))
+      exceeded = exceeded + 1
+      line = bdf.readline()
+      continue
+    if sec == 'ram':
+      used = ram_of(usage)
+    elif sec == 'rom':
+      used = rom_of(usage)
+    elif sec in usage:
+      used = usage[sec]
+    else:
+      print("%s: unknown section '%s', use text, data, bss, ram or rom" % (budgetfile, sec))
+      exceeded = exceeded + 1
+      line = bdf.readline()
+      continue
+    if used > limit:
+      print("%s %s: %d bytes used, budget is %d bytes (+%d)" % (scope, sec, used, limit, used - limit))
+      exceeded = exceeded + 1
+    line = bdf.readline()
+  bdf.close()
+  return exceeded
+
+if __name__ == "__main__":
+  main(sys.argv[1:])
@@ -33,8 +33,22 @@
 #ifndef PROJECT_CONF_H_
 #define PROJECT_CONF_H_
 
+/* Generated packet buffer: 1 for a packed ring of (seqn, payload), 3 bytes per
+ * packet, 0 for the original memb queue, 9 bytes per packet */
+#ifndef DATA_QUEUE_CONF_RING
+#define DATA_QUEUE_CONF_RING  1
+#endif /* DATA_QUEUE_CONF_RING */
+
 /* Max size of the generated packet buffer */
+#if DATA_QUEUE_CONF_RING
+#define PACKET_QUEUE_SIZE   200
+#else
 #define PACKET_QUEUE_SIZE   100
+#endif /* DATA_QUEUE_CONF_RING */
+
+/* Number of radio receive buffers (one superpacket each, short frames are packed
+ * into the last queued buffer at the sink) */
+#define RX_BUFFER_COUNT     12
 
 /* --- PLATFORM dependent definitions --- */
 
@@ -55,6 +69,9 @@
   #endif /* FLOCKLAB */
 
   #define RF_CHANNEL                    10 /* approx. 869 MHz */
+  /* channels for concurrent subtrees, the first one is used for sync and discovery */
+  #define RF_CHANNEL_LIST               { RF_CHANNEL, 12, 14, 16 }
+  #define RADIO_SET_CHANNEL(ch)         rf1a_set_channel(ch)
 
 #elif defined PLATFORM_SKY
   #ifdef FLOCKLAB
@@ -76,6 +93,9 @@
   #define CC2420_CONF_ADDRDECODE        0
   #define CC2420_CONF_SFD_TIMESTAMPS    0
   #define RF_CHANNEL                    26
+  /* channels for concurrent subtrees, the first one is used for sync and discovery */
+  #define RF_CHANNEL_LIST               { RF_CHANNEL, 25, 20, 15 }
+  #define RADIO_SET_CHANNEL(ch)         cc2420_set_channel(ch)
 
 #endif /* PLATFORM_DPP_CC430 */
 
@@ -87,5 +107,6 @@
 #define RF_CONF_MAX_PKT_LEN             (RADIO_CONF_PAYLOAD_LEN + 10)
 #define RF_CONF_TX_POWER                RF1A_TX_POWER_0_dBm
 #define RF_CONF_TX_CH                   RF_CHANNEL
+#define RF_CHANNEL_COUNT                4
 
 #endif /* PROJECT_CONF_H_ */